@@ -0,0 +1,50 @@
+#include "async_lcew.hpp"
+
+AsyncLcew::AsyncLcew(vector<int> txt, int t, vector<int> wc, LcewOptions opts,
+                     std::function<void(const Lcew &)> on_ready)
+    : text(std::move(txt)), ready(nullptr)
+{
+    assert(t > 0);
+    unordered_set<int> wildcards(wc.begin(), wc.end());
+    is_wc.resize(text.size());
+    for (size_t i = 0; i < text.size(); i++)
+        is_wc[i] = wildcards.contains(text[i]);
+
+    // The builder gets its own copy of the text, since `Lcew` owns one
+    auto build = [this, txt = text, t, wc = std::move(wc), opts, on_ready = std::move(on_ready)]() mutable
+    {
+        ds = std::make_unique<Lcew>(std::move(txt), t, std::move(wc), opts);
+        ready.store(ds.get(), std::memory_order_release);
+        if (on_ready)
+            on_ready(*ds);
+    };
+    done = std::async(std::launch::async, std::move(build)).share();
+}
+
+AsyncLcew::~AsyncLcew()
+{
+    done.wait();
+}
+
+int AsyncLcew::lcew_scan(int i, int j) const
+{
+    int n = text.size();
+    int r = 0;
+    while (i + r < n && j + r < n &&
+           (text[i + r] == text[j + r] || is_wc[i + r] || is_wc[j + r]))
+        r++;
+    return r;
+}
+
+int AsyncLcew::lcew(int i, int j) const
+{
+    if (const Lcew *index = ready.load(std::memory_order_acquire))
+        return index->lcew(i, j);
+    return lcew_scan(i, j);
+}
+
+const Lcew &AsyncLcew::index() const
+{
+    done.get();
+    return *ds;
+}
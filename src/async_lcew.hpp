@@ -0,0 +1,73 @@
+#pragma once
+
+#include "lcew.hpp"
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+using std::vector;
+
+/**
+ * LCEW data structure built in the background.
+ *
+ * Queries can be made right after construction: until the index is ready,
+ * they are answered by comparing the suffixes symbol by symbol (in time
+ * `O(LCEW)`), then by the index, which is switched to atomically.
+ * Queries may be made concurrently from several threads.
+ */
+class AsyncLcew
+{
+private:
+    vector<int> text;
+    /** `is_wc[i]` is true if `T[i]` is a wildcard, for the fallback. */
+    vector<char> is_wc;
+    std::unique_ptr<Lcew> ds;
+    /** `ds.get()` once the index is built, null before. */
+    std::atomic<const Lcew *> ready;
+    std::shared_future<void> done;
+
+    int lcew_scan(int i, int j) const;
+
+public:
+    /**
+     * Start building the LCEW data structure on a background thread.
+     *
+     * Parameters are the same as for `Lcew`. If given, `on_ready` is called
+     * (on the background thread) once queries are answered by the index.
+     */
+    AsyncLcew(vector<int> txt, int t, vector<int> wc = {DEFAULT_WILDCARD}, LcewOptions opts = {},
+              std::function<void(const Lcew &)> on_ready = {});
+
+    /**
+     * Wait for the end of the construction, if it is still running.
+     */
+    ~AsyncLcew();
+
+    AsyncLcew(const AsyncLcew &) = delete;
+    AsyncLcew &operator=(const AsyncLcew &) = delete;
+
+    /**
+     * Get the value of the LCEW between `T[i..]` and `T[j..]`
+     */
+    int lcew(int i, int j) const;
+
+    int size() const { return text.size(); };
+
+    /**
+     * Whether queries are answered by the index.
+     */
+    bool is_ready() const { return ready.load(std::memory_order_acquire) != nullptr; };
+
+    /**
+     * Future that becomes ready with the index. Rethrows the exception
+     * thrown by the construction, if any (queries then keep using the fallback).
+     */
+    std::shared_future<void> future() const { return done; };
+
+    /**
+     * Wait for the index, and return it.
+     */
+    const Lcew &index() const;
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Bit vector with rank and select support.
+ *
+ * Stores the bits in 64-bit words and, for every block of 8 words, the
+ * number of ones before the block and the number of ones before each word
+ * of the block (packed in 9-bit fields), plus the block of every
+ * `SELECT_SAMPLE`-th one: about 1.25 bits per position. `rank` takes
+ * constant time. So does `select`: the groups of `SELECT_SAMPLE` ones
+ * spread over more than `DENSE_SPAN` positions keep the positions of their
+ * ones (at most 1/32 bit per position), and in the other groups, the one
+ * is found by a binary search over at most `DENSE_SPAN / 512 + 2` blocks.
+ */
+class BitVector
+{
+private:
+    static constexpr int BLOCK_WORDS = 8;
+    static constexpr int SELECT_SAMPLE = 64;
+    /** Largest span of the groups of ones found by a search of the blocks. */
+    static constexpr size_t DENSE_SPAN = 1 << 16;
+    static constexpr uint32_t NO_INVENTORY = UINT32_MAX;
+    /** Blocks read by `distance_to_next` before falling back to `select`. */
+    static constexpr size_t SCAN_BLOCKS = 4;
+
+    size_t n = 0;
+    vector<uint64_t> words;
+    /** Counts of ones of a block of words, read together by `rank`. */
+    struct Block
+    {
+        /**
+         * Bits `9 * (w - 1)` to `9 * w` are the number of ones in the first
+         * `w` words of the block, for `1 <= w < BLOCK_WORDS`.
+         */
+        uint64_t relative;
+        /** Number of ones in the words before the block. */
+        uint32_t count;
+    };
+    /** One per block, plus a last one with the total number of ones. */
+    vector<Block> blocks;
+    /** `samples[s]` is the block of the one of rank `s * SELECT_SAMPLE`. */
+    vector<uint32_t> samples;
+    /**
+     * `inventory[sparse[s] + q]` is the position of the one of rank
+     * `s * SELECT_SAMPLE + q`, unless `sparse[s]` is `NO_INVENTORY`.
+     */
+    vector<uint32_t> sparse, inventory;
+
+    /**
+     * Position of the one of rank `k` in the word `w`.
+     */
+    static int select_in_word(uint64_t w, int k)
+    {
+        for (; k > 0; k--)
+            w &= w - 1;
+        return std::countr_zero(w);
+    }
+
+    /**
+     * Number of ones in the first `w` words of block `b`.
+     */
+    size_t count_in_block(size_t b, size_t w) const
+    {
+        return w == 0 ? 0 : blocks[b].relative >> (9 * (w - 1)) & 511;
+    }
+
+    /**
+     * Position of the one of rank `k`, which is in block `b`.
+     */
+    size_t select_in_block(size_t b, size_t k) const
+    {
+        k -= blocks[b].count;
+        size_t w = BLOCK_WORDS - 1;
+        while (count_in_block(b, w) > k)
+            w--;
+        k -= count_in_block(b, w);
+        return 64 * (b * BLOCK_WORDS + w) + select_in_word(words[b * BLOCK_WORDS + w], k);
+    }
+
+    void build_block(size_t b)
+    {
+        blocks[b].relative = 0;
+        size_t c = 0;
+        for (int w = 0; w < BLOCK_WORDS; w++)
+        {
+            if (w > 0)
+                blocks[b].relative |= (uint64_t)c << (9 * (w - 1));
+            c += std::popcount(words[b * BLOCK_WORDS + w]);
+        }
+    }
+
+    /**
+     * Position of the one of rank `k`, found by a binary search of the
+     * blocks between two samples, of which only the first `max_blocks`.
+     */
+    size_t search(size_t k, size_t max_blocks) const
+    {
+        // Last block with at most k ones before it
+        size_t s = k / SELECT_SAMPLE;
+        auto first = blocks.begin() + samples[s] + 1;
+        auto last = s + 1 < samples.size() ? blocks.begin() + samples[s + 1] + 1 : blocks.end();
+        if ((size_t)(last - first) > max_blocks)
+            last = first + max_blocks;
+        auto after = std::upper_bound(first, last, k, [](size_t k, const Block &b)
+                                      { return k < b.count; });
+        return select_in_block(after - blocks.begin() - 1, k);
+    }
+
+    void build_samples()
+    {
+        samples.clear();
+        size_t nb_blocks = blocks.size() - 1;
+        for (size_t b = 0; b < nb_blocks; b++)
+        {
+            // Ones of the block whose rank is a multiple of SELECT_SAMPLE
+            for (size_t k = (blocks[b].count + SELECT_SAMPLE - 1) / SELECT_SAMPLE * SELECT_SAMPLE; k < blocks[b + 1].count; k += SELECT_SAMPLE)
+                samples.push_back(b);
+        }
+
+        sparse.assign(samples.size(), NO_INVENTORY);
+        inventory.clear();
+        for (size_t s = 0; s < samples.size(); s++)
+        {
+            // Span of the group, up to the first one of the next group
+            size_t first = s * SELECT_SAMPLE, end = std::min(ones(), first + SELECT_SAMPLE);
+            size_t start = select_in_block(samples[s], first);
+            size_t stop = s + 1 < samples.size() ? select_in_block(samples[s + 1], end) : search(end - 1, SIZE_MAX);
+            if (stop - start <= DENSE_SPAN)
+                continue;
+            sparse[s] = inventory.size();
+            for (size_t k = first; k < end; k++)
+                inventory.push_back(search(k, SIZE_MAX));
+        }
+    }
+
+public:
+    BitVector() = default;
+
+    /**
+     * Bit vector of `bits.size()` positions, with `bits[i]` at position `i`.
+     */
+    template <class Bits>
+    explicit BitVector(const Bits &bits) : n(bits.size())
+    {
+        size_t nb_blocks = (n + 64 * BLOCK_WORDS - 1) / (64 * BLOCK_WORDS);
+        words.assign(nb_blocks * BLOCK_WORDS, 0);
+        for (size_t i = 0; i < n; i++)
+            if (bits[i])
+                words[i / 64] |= 1ULL << (i % 64);
+
+        blocks.assign(nb_blocks + 1, {0, 0});
+        for (size_t b = 0; b < nb_blocks; b++)
+        {
+            build_block(b);
+            blocks[b + 1].count = blocks[b].count + count_in_block(b, BLOCK_WORDS - 1) +
+                                  std::popcount(words[b * BLOCK_WORDS + BLOCK_WORDS - 1]);
+        }
+        build_samples();
+    }
+
+    size_t size() const { return n; }
+
+    /**
+     * Number of ones.
+     */
+    size_t ones() const { return blocks.back().count; }
+
+    bool operator[](size_t i) const
+    {
+        return words[i / 64] >> (i % 64) & 1;
+    }
+
+    /**
+     * Number of ones before position `i`.
+     */
+    size_t rank(size_t i) const
+    {
+        size_t b = i / (64 * BLOCK_WORDS);
+        size_t res = blocks[b].count + count_in_block(b, i / 64 % BLOCK_WORDS);
+        if (i % 64)
+            res += std::popcount(words[i / 64] << (64 - i % 64));
+        return res;
+    }
+
+    /**
+     * Position of the one of rank `k`, for `k < ones()`.
+     */
+    size_t select(size_t k) const
+    {
+        assert(k < ones());
+        size_t s = k / SELECT_SAMPLE;
+        if (sparse[s] != NO_INVENTORY)
+            return inventory[sparse[s] + k % SELECT_SAMPLE];
+        // The block of the one is at most DENSE_SPAN positions after the sample
+        return search(k, DENSE_SPAN / (64 * BLOCK_WORDS) + 2);
+    }
+
+    /**
+     * Distance from `i` to the first one at or after position `i`,
+     * which must exist.
+     */
+    int distance_to_next(size_t i) const
+    {
+        size_t q = i / 64;
+        uint64_t w = words[q] >> (i % 64);
+        if (w)
+            return std::countr_zero(w);
+        // Ones are often close: look in the rest of the block of i,
+        // which is in the same cache line, then in the next few blocks
+        for (q++; q % BLOCK_WORDS; q++)
+            if (words[q])
+                return 64 * q + std::countr_zero(words[q]) - i;
+        size_t b = q / BLOCK_WORDS;
+        size_t k = blocks[b].count;
+        for (size_t end = std::min(blocks.size() - 1, b + SCAN_BLOCKS); b < end; b++)
+            if (blocks[b + 1].count > k)
+                return select_in_block(b, k) - i;
+        return select(k) - i;
+    }
+
+    /**
+     * Set the bit at position `i` to `value`, in `O(n / 512 + ones() / 64)` time.
+     */
+    void set(size_t i, bool value)
+    {
+        if ((*this)[i] == value)
+            return;
+        words[i / 64] ^= 1ULL << (i % 64);
+        build_block(i / (64 * BLOCK_WORDS));
+        for (size_t b = i / (64 * BLOCK_WORDS) + 1; b < blocks.size(); b++)
+            blocks[b].count += value ? 1 : -1;
+        build_samples();
+    }
+
+    /**
+     * Memory used by the bit vector, in bytes.
+     */
+    size_t memory_usage() const
+    {
+        return words.capacity() * sizeof(uint64_t) + blocks.capacity() * sizeof(Block) +
+               (samples.capacity() + sparse.capacity() + inventory.capacity()) * sizeof(uint32_t);
+    }
+};
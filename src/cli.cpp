@@ -0,0 +1,393 @@
+#include "cli.hpp"
+#include "lcew.hpp"
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <string>
+#include <thread>
+
+namespace
+{
+    const char *USAGE =
+        "Usage: main lcew TEXT_FILE [options]\n"
+        "\n"
+        "Builds the LCEW data structure over the bytes of TEXT_FILE (without its\n"
+        "final newline, if any), then reads queries `i j` (0-indexed, one per line)\n"
+        "and writes the LCEW of each query on its own line, in the same order.\n"
+        "\n"
+        "Options:\n"
+        "  -t T         parameter of the data structure (query time O(T), default 64)\n"
+        "  -w SYMBOLS   wildcard symbols (default '#')\n"
+        "  -q FILE      read queries from FILE (default: standard input)\n"
+        "  -o FILE      write answers to FILE (default: standard output)\n"
+        "  -j THREADS   number of worker threads (default: number of cores)\n"
+        "  -s SAMPLE    use the fingerprint LCE backend, keeping one fingerprint\n"
+        "               every SAMPLE positions\n"
+        "  -v           print memory usage (and construction times, if built\n"
+        "               with `make stats`) to standard error\n";
+
+    /** Number of queries handled together by a worker. */
+    const size_t BATCH_SIZE = 1 << 16;
+    /** Size of the blocks read from the query file. */
+    const size_t READ_SIZE = 1 << 20;
+
+    struct Batch
+    {
+        size_t id;
+        vector<std::pair<int, int>> queries;
+        string answers;
+    };
+
+    /**
+     * Multiple producers, multiple consumers queue.
+     */
+    template <class T>
+    class BlockingQueue
+    {
+    private:
+        std::deque<T> items;
+        bool closed = false;
+        std::mutex mtx;
+        std::condition_variable cv;
+
+    public:
+        void push(T x)
+        {
+            {
+                std::lock_guard lock(mtx);
+                items.push_back(std::move(x));
+            }
+            cv.notify_one();
+        }
+
+        /**
+         * Wait for an element. Returns nothing once the queue is closed and empty.
+         */
+        std::optional<T> pop()
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [&]
+                    { return closed || !items.empty(); });
+            if (items.empty())
+                return std::nullopt;
+            T x = std::move(items.front());
+            items.pop_front();
+            return x;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard lock(mtx);
+                closed = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    struct Options
+    {
+        string text_file;
+        string query_file;
+        string output_file;
+        int t = 64;
+        // DEFAULT_WILDCARD, as a symbol (see `symbols`)
+        vector<int> wildcards = {DEFAULT_WILDCARD + 1};
+        int threads = std::max(1u, std::thread::hardware_concurrency());
+        LcewOptions lcew;
+        bool verbose = false;
+    };
+
+    /**
+     * Symbols of the bytes of `s`: byte `b` is the symbol `b + 1`, since
+     * the convolutions of `pm_wc` use 0 for the wildcards.
+     */
+    vector<int> symbols(const string &s)
+    {
+        vector<int> res;
+        res.reserve(s.size());
+        for (unsigned char b : s)
+            res.push_back(b + 1);
+        return res;
+    }
+
+    std::optional<Options> parse_args(int argc, char **argv)
+    {
+        Options opts;
+        vector<string> args(argv + 2, argv + argc);
+        for (size_t k = 0; k < args.size(); k++)
+        {
+            const string &a = args[k];
+            auto value = [&]() -> std::optional<string>
+            {
+                if (k + 1 >= args.size())
+                    return std::nullopt;
+                return args[++k];
+            };
+            auto int_value = [&]() -> std::optional<int>
+            {
+                auto v = value();
+                int x;
+                if (!v || std::from_chars(v->data(), v->data() + v->size(), x).ec != std::errc() || x <= 0)
+                    return std::nullopt;
+                return x;
+            };
+
+            if (a == "-t" || a == "-j" || a == "-s")
+            {
+                auto x = int_value();
+                if (!x)
+                    return std::nullopt;
+                if (a == "-t")
+                    opts.t = *x;
+                else if (a == "-j")
+                    opts.threads = *x;
+                else
+                {
+                    opts.lcew.backend = LceBackend::Fingerprint;
+                    opts.lcew.sample = *x;
+                }
+            }
+            else if (a == "-w" || a == "-q" || a == "-o")
+            {
+                auto v = value();
+                if (!v)
+                    return std::nullopt;
+                if (a == "-w")
+                    opts.wildcards = symbols(*v);
+                else if (a == "-q")
+                    opts.query_file = *v;
+                else
+                    opts.output_file = *v;
+            }
+            else if (a == "-v")
+                opts.verbose = true;
+            else if (opts.text_file.empty() && a[0] != '-')
+                opts.text_file = a;
+            else
+                return std::nullopt;
+        }
+
+        if (opts.text_file.empty())
+            return std::nullopt;
+        return opts;
+    }
+
+    std::optional<vector<int>> read_text(const string &name)
+    {
+        std::ifstream in(name, std::ios::binary);
+        if (!in)
+            return std::nullopt;
+        string s((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!s.empty() && s.back() == '\n')
+            s.pop_back();
+        if (!s.empty() && s.back() == '\r')
+            s.pop_back();
+        return symbols(s);
+    }
+
+    /**
+     * Parse the queries from `in` into batches, and push them in `work`.
+     *
+     * `slots` bounds the number of batches in flight.
+     * Returns false, after printing an error, if the input is malformed.
+     */
+    bool read_queries(FILE *in, int n, BlockingQueue<Batch> &work, std::counting_semaphore<> &slots)
+    {
+        Batch batch{0, {}, {}};
+        batch.queries.reserve(BATCH_SIZE);
+        vector<char> buf(READ_SIZE);
+        long long vals[2];
+        int nb_vals = 0;
+        long long cur = 0;
+        bool in_number = false;
+        size_t line = 1;
+
+        auto end_number = [&]()
+        {
+            if (in_number)
+            {
+                // Remember that there were too many values
+                if (nb_vals == 2)
+                    nb_vals = 3;
+                else if (nb_vals < 2)
+                    vals[nb_vals++] = cur;
+                in_number = false;
+            }
+        };
+
+        auto flush = [&]()
+        {
+            slots.acquire();
+            size_t id = batch.id;
+            work.push(std::move(batch));
+            batch = Batch{id + 1, {}, {}};
+            batch.queries.reserve(BATCH_SIZE);
+        };
+
+        auto end_line = [&]() -> bool
+        {
+            if (nb_vals == 0)
+                return true;
+            if (nb_vals != 2 || vals[0] >= n || vals[1] >= n)
+            {
+                std::cerr << "line " << line << ": expected two positions in [0, " << n << ")\n";
+                // Still answer the previous queries
+                flush();
+                return false;
+            }
+            batch.queries.emplace_back(vals[0], vals[1]);
+            nb_vals = 0;
+            if (batch.queries.size() == BATCH_SIZE)
+                flush();
+            return true;
+        };
+
+        size_t len;
+        while ((len = fread(buf.data(), 1, buf.size(), in)) > 0)
+        {
+            for (size_t k = 0; k < len; k++)
+            {
+                char c = buf[k];
+                if ('0' <= c && c <= '9')
+                {
+                    cur = in_number ? 10 * cur + (c - '0') : c - '0';
+                    in_number = true;
+                    // Larger values are rejected anyway
+                    cur = std::min(cur, (long long)INT32_MAX);
+                    continue;
+                }
+
+                end_number();
+                if (c == '\n')
+                {
+                    if (!end_line())
+                        return false;
+                    line++;
+                }
+                else if (c != ' ' && c != '\t' && c != '\r')
+                {
+                    std::cerr << "line " << line << ": unexpected character '" << c << "'\n";
+                    flush();
+                    return false;
+                }
+            }
+        }
+
+        end_number();
+        if (!end_line())
+            return false;
+        if (!batch.queries.empty())
+            flush();
+        return true;
+    }
+
+    void answer_queries(const Lcew &ds, BlockingQueue<Batch> &work, BlockingQueue<Batch> &done)
+    {
+        while (auto batch = work.pop())
+        {
+            char num[16];
+            batch->answers.reserve(batch->queries.size() * 4);
+            for (auto [i, j] : batch->queries)
+            {
+                auto end = std::to_chars(num, num + sizeof(num), ds.lcew(i, j)).ptr;
+                *end++ = '\n';
+                batch->answers.append(num, end);
+            }
+            batch->queries = {};
+            done.push(std::move(*batch));
+        }
+    }
+
+    /**
+     * Write the answers of the batches in `done` to `out`, in order.
+     */
+    void write_answers(FILE *out, BlockingQueue<Batch> &done, std::counting_semaphore<> &slots)
+    {
+        std::map<size_t, string> pending;
+        size_t next = 0;
+        while (auto batch = done.pop())
+        {
+            pending.emplace(batch->id, std::move(batch->answers));
+            for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it))
+            {
+                fwrite(it->second.data(), 1, it->second.size(), out);
+                next++;
+                slots.release();
+            }
+        }
+        fflush(out);
+    }
+}
+
+int run_cli(int argc, char **argv)
+{
+    if (argc < 2 || string(argv[1]) != "lcew")
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    auto opts = parse_args(argc, argv);
+    if (!opts)
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    auto txt = read_text(opts->text_file);
+    if (!txt || txt->empty())
+    {
+        std::cerr << "cannot read a non-empty text from " << opts->text_file << "\n";
+        return 1;
+    }
+
+    FILE *in = opts->query_file.empty() ? stdin : fopen(opts->query_file.c_str(), "rb");
+    FILE *out = opts->output_file.empty() ? stdout : fopen(opts->output_file.c_str(), "wb");
+    if (!in || !out)
+    {
+        std::cerr << "cannot open " << (in ? opts->output_file : opts->query_file) << "\n";
+        return 1;
+    }
+
+    int n = txt->size();
+    Lcew ds(std::move(*txt), opts->t, opts->wildcards, opts->lcew);
+    if (opts->verbose)
+    {
+        LCEW_STATS_ONLY(std::cerr << "construction: " << ds.build_stats() << "\n");
+        std::cerr << "memory: " << ds.memory_usage() << "\n";
+    }
+
+    // Reader (this thread) -> workers -> writer, with at most
+    // 4 batches per worker between the reader and the writer.
+    BlockingQueue<Batch> work, done;
+    std::counting_semaphore<> slots(4 * opts->threads);
+    vector<std::thread> workers;
+    for (int k = 0; k < opts->threads; k++)
+        workers.emplace_back(answer_queries, std::cref(ds), std::ref(work), std::ref(done));
+    std::thread writer(write_answers, out, std::ref(done), std::ref(slots));
+
+    bool ok = read_queries(in, n, work, slots);
+
+    work.close();
+    for (auto &w : workers)
+        w.join();
+    done.close();
+    writer.join();
+
+    if (in != stdin)
+        fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    return ok ? 0 : 1;
+}
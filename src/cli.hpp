@@ -0,0 +1,13 @@
+/**
+ * Command-line interface: build an LCEW data structure over a file
+ * and answer queries in bulk.
+ */
+
+#pragma once
+
+/**
+ * Run the command line interface with the arguments of `main`.
+ *
+ * Returns the exit code of the program.
+ */
+int run_cli(int argc, char **argv);
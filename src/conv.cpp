@@ -0,0 +1,403 @@
+#include "conv.hpp"
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <complex>
+
+typedef unsigned long long ULL;
+typedef unsigned __int128 U128;
+typedef complex<double> cd;
+
+namespace
+{
+    /** Below this size, Karatsuba's algorithm uses the schoolbook algorithm. */
+    const size_t KARATSUBA_BASE = 32;
+
+    /** Number of bits per limb in the floating point FFT. */
+    const int LIMB_BITS = 11;
+    const int NB_LIMBS = 3; // NTT_MOD < 2^(3 * 11)
+
+    unsigned add(unsigned a, unsigned b)
+    {
+        unsigned res = a + b;
+        return res >= NTT_MOD ? res - NTT_MOD : res;
+    }
+
+    unsigned sub(unsigned a, unsigned b)
+    {
+        return a >= b ? a - b : a + NTT_MOD - b;
+    }
+
+    /**
+     * Schoolbook convolution of `a` and `b`, written to `res` (of size na + nb - 1).
+     */
+    void direct(const unsigned *a, size_t na, const unsigned *b, size_t nb, unsigned *res)
+    {
+        for (size_t k = 0; k < na + nb - 1; k++)
+        {
+            size_t lo = k >= nb ? k - nb + 1 : 0;
+            size_t hi = std::min(k, na - 1);
+            U128 acc = 0;
+            for (size_t i = lo; i <= hi; i++)
+                acc += (ULL)a[i] * b[k - i];
+            res[k] = acc % NTT_MOD;
+        }
+    }
+
+    /**
+     * Size of the scratch space needed by `karatsuba` for inputs of size `l`.
+     */
+    size_t karatsuba_scratch(size_t l)
+    {
+        if (l <= KARATSUBA_BASE)
+            return 0;
+        size_t h2 = l - l / 2;
+        return 4 * h2 + karatsuba_scratch(h2);
+    }
+
+    /**
+     * Karatsuba convolution of `a` and `b`, both of size `l`,
+     * written to `res` (of size 2l - 1), using `karatsuba_scratch(l)`
+     * entries of `scratch`.
+     */
+    void karatsuba(const unsigned *a, const unsigned *b, size_t l, unsigned *res, unsigned *scratch)
+    {
+        if (l <= KARATSUBA_BASE)
+        {
+            direct(a, l, b, l, res);
+            return;
+        }
+
+        // a = a0 + x^h a1, with a1 at least as long as a0
+        size_t h = l / 2, h2 = l - h;
+        unsigned *z1 = scratch, *sa = z1 + 2 * h2, *sb = sa + h2, *rest = sb + h2;
+        for (size_t i = 0; i < h2; i++)
+        {
+            sa[i] = i < h ? add(a[h + i], a[i]) : a[h + i];
+            sb[i] = i < h ? add(b[h + i], b[i]) : b[h + i];
+        }
+
+        // z0 = a0 b0 and z2 = a1 b1 go directly to their place in `res`
+        unsigned *z0 = res, *z2 = res + 2 * h;
+        karatsuba(a, b, h, z0, rest);
+        res[2 * h - 1] = 0;
+        karatsuba(a + h, b + h, h2, z2, rest);
+        karatsuba(sa, sb, h2, z1, rest);
+
+        // z1 = (a0 + a1)(b0 + b1) - a0 b0 - a1 b1
+        for (size_t i = 0; i < 2 * h - 1; i++)
+            z1[i] = sub(z1[i], z0[i]);
+        for (size_t i = 0; i < 2 * h2 - 1; i++)
+            z1[i] = sub(z1[i], z2[i]);
+
+        for (size_t i = 0; i < 2 * h2 - 1; i++)
+            res[i + h] = add(res[i + h], z1[i]);
+    }
+
+    /**
+     * Karatsuba convolution of vectors of arbitrary sizes, written to `res`:
+     * the longest one is cut into chunks of the size of the shortest one.
+     */
+    void conv_karatsuba(std::span<const unsigned> A, std::span<const unsigned> B, std::span<unsigned> res,
+                        vector<unsigned> &scratch)
+    {
+        std::span<const unsigned> s = A.size() <= B.size() ? A : B;
+        std::span<const unsigned> l = A.size() <= B.size() ? B : A;
+        size_t m = s.size();
+
+        scratch.resize(m + 2 * m - 1 + karatsuba_scratch(m));
+        unsigned *chunk = scratch.data(), *prod = chunk + m, *rest = prod + 2 * m - 1;
+        std::fill(res.begin(), res.end(), 0);
+        for (size_t start = 0; start < l.size(); start += m)
+        {
+            size_t len = std::min(m, l.size() - start);
+            std::copy(l.begin() + start, l.begin() + start + len, chunk);
+            std::fill(chunk + len, chunk + m, 0);
+            karatsuba(chunk, s.data(), m, prod, rest);
+            for (size_t i = 0; i < 2 * m - 1 && start + i < res.size(); i++)
+                res[start + i] = add(res[start + i], prod[i]);
+        }
+    }
+
+    /**
+     * In-place complex FFT of size a.size() (a power of two),
+     * with `rt[i] = exp(2 i pi i / N)`.
+     */
+    void fft_complex(vector<cd> &a, const vector<cd> &rt)
+    {
+        size_t N = a.size();
+        for (size_t i = 1, j = 0; i < N; i++)
+        {
+            size_t bit = N >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                swap(a[i], a[j]);
+        }
+
+        for (size_t len = 2; len <= N; len <<= 1)
+        {
+            size_t step = N / len;
+            for (size_t i = 0; i < N; i += len)
+            {
+                for (size_t j = 0; j < len / 2; j++)
+                {
+                    cd u = a[i + j], v = a[i + j + len / 2] * rt[j * step];
+                    a[i + j] = u + v;
+                    a[i + j + len / 2] = u - v;
+                }
+            }
+        }
+    }
+
+    /**
+     * Convolution with a floating point FFT, splitting entries into limbs of
+     * LIMB_BITS bits, so that the exact products fit in the mantissa.
+     *
+     * Returns false, leaving `res` unspecified, if the rounding error cannot
+     * be guaranteed to be small enough to recover the exact result.
+     */
+    bool conv_fft(std::span<const unsigned> A, std::span<const unsigned> B, std::span<unsigned> res)
+    {
+        size_t len = A.size() + B.size() - 1;
+        size_t N = std::bit_ceil(len);
+        const unsigned mask = (1u << LIMB_BITS) - 1;
+
+        // Error bound: the rounding error of each product of limb vectors x, y
+        // is at most ||x|| ||y|| eps (c log2 N) for a small constant c;
+        // each output coefficient sums NB_LIMBS such products, and packing
+        // two real vectors in one complex vector at most doubles the error.
+        double norm_a = 0, norm_b = 0;
+        for (int d = 0; d < NB_LIMBS; d++)
+        {
+            double na = 0, nb = 0;
+            for (unsigned x : A)
+                na += std::pow((x >> (LIMB_BITS * d)) & mask, 2);
+            for (unsigned x : B)
+                nb += std::pow((x >> (LIMB_BITS * d)) & mask, 2);
+            norm_a = std::max(norm_a, std::sqrt(na));
+            norm_b = std::max(norm_b, std::sqrt(nb));
+        }
+        double eps = std::ldexp(1.0, -52);
+        double bound = 2 * NB_LIMBS * norm_a * norm_b * eps * (6 * std::bit_width(N) + 6);
+        if (bound >= 0.25)
+            return false;
+
+        vector<cd> rt(std::max<size_t>(N / 2, 1));
+        for (size_t i = 0; i < rt.size(); i++)
+            rt[i] = std::polar(1.0, 2 * M_PI * i / N);
+
+        // Limbs of A and B packed two by two: (a0, a1), (a2, b0), (b1, b2)
+        auto limb = [&](std::span<const unsigned> v, size_t i, int d) -> double
+        {
+            return i < v.size() ? (v[i] >> (LIMB_BITS * d)) & mask : 0;
+        };
+        vector<cd> z[3];
+        for (auto &zi : z)
+            zi.assign(N, 0);
+        for (size_t i = 0; i < N; i++)
+        {
+            z[0][i] = cd(limb(A, i, 0), limb(A, i, 1));
+            z[1][i] = cd(limb(A, i, 2), limb(B, i, 0));
+            z[2][i] = cd(limb(B, i, 1), limb(B, i, 2));
+        }
+        for (auto &zi : z)
+            fft_complex(zi, rt);
+
+        // Unpack the spectra, multiply them, and pack the five products
+        // c0..c4 (the limbs of the result) two by two for the inverse transforms.
+        vector<cd> w[3];
+        for (auto &wi : w)
+            wi.assign(N, 0);
+        for (size_t k = 0; k < N; k++)
+        {
+            size_t k2 = (N - k) & (N - 1);
+            cd spec[6];
+            for (int p = 0; p < 3; p++)
+            {
+                cd u = z[p][k], v = std::conj(z[p][k2]);
+                spec[2 * p] = (u + v) * 0.5;
+                spec[2 * p + 1] = (u - v) * cd(0, -0.5);
+            }
+            cd *x = spec, *y = spec + 3;
+            cd c[5];
+            for (int d = 0; d < 5; d++)
+                for (int p = 0; p < NB_LIMBS; p++)
+                    if (0 <= d - p && d - p < NB_LIMBS)
+                        c[d] += x[p] * y[d - p];
+
+            // Inverse transform computed as conj(FFT(conj(.)))
+            w[0][k] = std::conj(c[0] + cd(0, 1) * c[1]);
+            w[1][k] = std::conj(c[2] + cd(0, 1) * c[3]);
+            w[2][k] = std::conj(c[4]);
+        }
+        for (auto &wi : w)
+            fft_complex(wi, rt);
+
+        ULL pow_limb[5];
+        pow_limb[0] = 1;
+        for (int d = 1; d < 5; d++)
+            pow_limb[d] = (pow_limb[d - 1] << LIMB_BITS) % NTT_MOD;
+
+        double max_err = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            double c[5] = {w[0][i].real(), -w[0][i].imag(), w[1][i].real(), -w[1][i].imag(), w[2][i].real()};
+            ULL acc = 0;
+            for (int d = 0; d < 5; d++)
+            {
+                double v = c[d] / N;
+                double r = std::round(v);
+                max_err = std::max(max_err, std::abs(v - r));
+                acc += (ULL)r % NTT_MOD * pow_limb[d] % NTT_MOD;
+            }
+            res[i] = acc % NTT_MOD;
+        }
+
+        // Check the bound a posteriori
+        return max_err < 0.25;
+    }
+}
+
+double conv_cost(ConvBackend backend, size_t na, size_t nb)
+{
+    double s = std::min(na, nb), l = std::max(na, nb);
+    if (s == 0)
+        return 0;
+
+    // Rough costs, in nanoseconds, measured on a x86-64 machine
+    double n = std::bit_ceil((size_t)(na + nb - 1));
+    double direct = 1.5 * s * l;
+    double karatsuba = s <= KARATSUBA_BASE ? direct : 8 * std::pow(s, std::log2(3)) * std::ceil(l / s);
+    double ntt = 3 * (2.5 * n * std::log2(n) + 4 * n);
+
+    switch (backend)
+    {
+    case ConvBackend::Direct:
+        return direct;
+    case ConvBackend::Karatsuba:
+        return karatsuba;
+    case ConvBackend::Ntt:
+        return ntt;
+    case ConvBackend::Fft:
+        // Four complex transforms of the same size, with more work per butterfly
+        return 2 * ntt;
+    case ConvBackend::Auto:
+        break;
+    }
+    return std::min({direct, karatsuba, ntt});
+}
+
+ConvBackend choose_conv_backend(size_t na, size_t nb)
+{
+    double direct = conv_cost(ConvBackend::Direct, na, nb);
+    double karatsuba = conv_cost(ConvBackend::Karatsuba, na, nb);
+    double ntt = conv_cost(ConvBackend::Ntt, na, nb);
+
+    if (direct <= karatsuba && direct <= ntt)
+        return ConvBackend::Direct;
+    if (karatsuba <= ntt)
+        return ConvBackend::Karatsuba;
+    return ConvBackend::Ntt;
+}
+
+ConvWorkspace &ConvWorkspace::local()
+{
+    thread_local ConvWorkspace ws;
+    return ws;
+}
+
+void convolve_into(std::span<const unsigned> A, std::span<const unsigned> B, std::span<unsigned> out,
+                   ConvBackend backend, ConvWorkspace &ws)
+{
+    if (A.empty() || B.empty())
+        return;
+    size_t len = A.size() + B.size() - 1;
+    assert(out.size() == len);
+
+    if (backend == ConvBackend::Auto)
+        backend = choose_conv_backend(A.size(), B.size());
+
+    switch (backend)
+    {
+    case ConvBackend::Direct:
+        direct(A.data(), A.size(), B.data(), B.size(), out.data());
+        break;
+    case ConvBackend::Karatsuba:
+        conv_karatsuba(A, B, out, ws.scratch);
+        break;
+    case ConvBackend::Fft:
+        if (conv_fft(A, B, out))
+            break;
+        [[fallthrough]];
+    default:
+    {
+        int n = std::bit_width(len - 1);
+        ws.a.assign(A.begin(), A.end());
+        ws.a.resize(1 << n, 0);
+        ws.b.assign(B.begin(), B.end());
+        ws.b.resize(1 << n, 0);
+        fft(std::span<unsigned>(ws.a), n);
+        fft(std::span<unsigned>(ws.b), n);
+        for (int i = 0; i < (1 << n); ++i)
+            ws.a[i] = (ULL)ws.a[i] * ws.b[i] % NTT_MOD;
+        fft(std::span<unsigned>(ws.a), n, true);
+        std::copy(ws.a.begin(), ws.a.begin() + len, out.begin());
+    }
+    }
+}
+
+void convolve_inplace(vector<unsigned> &A, vector<unsigned> &B, ConvBackend backend)
+{
+    if (A.empty() || B.empty())
+    {
+        A.clear();
+        return;
+    }
+
+    if (backend == ConvBackend::Auto)
+        backend = choose_conv_backend(A.size(), B.size());
+    if (backend == ConvBackend::Ntt)
+    {
+        conv_inplace(A, B);
+        return;
+    }
+
+    auto &out = ConvWorkspace::local().out;
+    out.resize(A.size() + B.size() - 1);
+    convolve_into(A, B, out, backend);
+    A.assign(out.begin(), out.end());
+}
+
+vector<unsigned> convolve(const vector<unsigned> &A, const vector<unsigned> &B, ConvBackend backend)
+{
+    vector<unsigned> a(A), b(B);
+    convolve_inplace(a, b, backend);
+    return a;
+}
+
+void test_conv(int it, std::mt19937 &rng)
+{
+    for (int i = 0; i < it; i++)
+    {
+        size_t na = 1 + rng() % 300, nb = 1 + rng() % 300;
+        // Small entries for the FFT to be exact, or arbitrary ones modulo NTT_MOD.
+        unsigned max = (i % 2) ? NTT_MOD - 1 : 255 * 255 * 255;
+        std::uniform_int_distribution<unsigned> distrib(0, max);
+        vector<unsigned> A(na), B(nb);
+        for (auto &x : A)
+            x = distrib(rng);
+        for (auto &x : B)
+            x = distrib(rng);
+
+        auto expected = convolve(A, B, ConvBackend::Direct);
+        vector<unsigned> out(na + nb - 1);
+        for (auto backend : {ConvBackend::Auto, ConvBackend::Karatsuba, ConvBackend::Ntt, ConvBackend::Fft})
+        {
+            assert(convolve(A, B, backend) == expected);
+            convolve_into(A, B, out, backend);
+            assert(out == expected);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/**
+ * \file conv.hpp
+ * \brief Convolution of integer vectors with several algorithms,
+ *        chosen automatically according to the sizes of the inputs.
+ *
+ * All backends compute the same result: the convolution modulo NTT_MOD
+ * of vectors with entries smaller than NTT_MOD.
+ */
+
+#pragma once
+
+#include "ntt.hpp"
+#include <random>
+#include <span>
+#include <vector>
+
+using std::vector;
+
+enum class ConvBackend
+{
+    /** Pick the cheapest of Direct, Karatsuba and Ntt for the input sizes. */
+    Auto,
+    /** Schoolbook algorithm, `O(|A| |B|)`. */
+    Direct,
+    /** Karatsuba's algorithm, `O(max * min^0.59)`. */
+    Karatsuba,
+    /** Number theoretic transform, `O(N log N)` with `N >= |A| + |B|`. */
+    Ntt,
+    /**
+     * Floating point FFT on 11-bit limbs, `O(N log N)` with larger constants.
+     * Falls back to Ntt when the rounding error could exceed 1/2.
+     */
+    Fft,
+};
+
+/**
+ * \brief Estimated running time, in nanoseconds, of a convolution of vectors
+ *        of sizes `na` and `nb` with `backend` (the cheapest one for Auto).
+ *
+ * The Ntt estimate counts three transforms of size `bit_ceil(na + nb - 1)`.
+ */
+double conv_cost(ConvBackend backend, size_t na, size_t nb);
+
+/**
+ * \brief The backend used by `ConvBackend::Auto` for inputs of sizes `na` and `nb`.
+ */
+ConvBackend choose_conv_backend(size_t na, size_t nb);
+
+/**
+ * \brief Computing the convolution of two integer vectors.
+ * \return the convolution of A and B modulo NTT_MOD, of size |A| + |B| - 1
+ */
+vector<unsigned> convolve(const vector<unsigned> &A, const vector<unsigned> &B,
+                          ConvBackend backend = ConvBackend::Auto);
+
+/**
+ * \brief Computing the convolution of two integer vectors in place.
+ * \param A the first vector, replaced by the convolution of A and B
+ * \param B the second vector, may be overwritten
+ *
+ * Same as `conv_inplace`, with any backend.
+ */
+void convolve_inplace(vector<unsigned> &A, vector<unsigned> &B,
+                      ConvBackend backend = ConvBackend::Auto);
+
+/**
+ * \brief Buffers reused by `convolve_into`.
+ *
+ * Buffers only grow, so that once they are large enough convolutions
+ * do no heap allocation.
+ */
+class ConvWorkspace
+{
+private:
+    vector<unsigned> a, b, out, scratch;
+
+    friend void convolve_into(std::span<const unsigned> A, std::span<const unsigned> B, std::span<unsigned> out,
+                              ConvBackend backend, ConvWorkspace &ws);
+    friend void convolve_inplace(vector<unsigned> &A, vector<unsigned> &B, ConvBackend backend);
+
+public:
+    /**
+     * \brief The workspace of the calling thread.
+     */
+    static ConvWorkspace &local();
+};
+
+/**
+ * \brief Computing the convolution of two integer vectors into a span.
+ * \param out the result, of size exactly |A| + |B| - 1
+ * \param ws buffers for the transforms and Karatsuba's algorithm
+ *
+ * With all backends but Fft, does no heap allocation once the buffers
+ * of `ws` are large enough.
+ */
+void convolve_into(std::span<const unsigned> A, std::span<const unsigned> B, std::span<unsigned> out,
+                   ConvBackend backend = ConvBackend::Auto, ConvWorkspace &ws = ConvWorkspace::local());
+
+void test_conv(int it, std::mt19937 &rng);
@@ -1,6 +1,9 @@
 #include "fast_mm.hpp"
 #include "lcew.hpp"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <iterator>
 
 /**
  * Write a SparseBoolMatrix to a string
@@ -30,40 +33,138 @@ void convert_to_string(vector<int> &v, const SparseBoolMatrix &a, bool lhs = tru
     v.insert(v.end(), res.begin(), res.end());
 }
 
-SparseBoolMatrix matrix_mult(const SparseBoolMatrix &a, const SparseBoolMatrix &b)
+/**
+ * Products `*lhs[s] * b` for all `s`, with a single index.
+ *
+ * The text is the strings of the matrices of `lhs` in row-major order,
+ * followed by the string of `b` in column-major order: `b` is converted
+ * once, and the LCEW queries of all the products use the same index.
+ */
+vector<SparseBoolMatrix> matrix_mult_shared(const vector<const SparseBoolMatrix *> &lhs, const SparseBoolMatrix &b)
 {
+    int n = b.n;
+    vector<SparseBoolMatrix> res(lhs.size(), SparseBoolMatrix{n, {}});
+    size_t nb_entries = b.entries.size();
+    for (auto a : lhs)
+        nb_entries += a->entries.size();
+    // Do not build an index over a text of wildcards
+    if (b.entries.empty() || nb_entries == b.entries.size())
+        return res;
+
     vector<int> txt;
-    convert_to_string(txt, a, true);
+    txt.reserve((lhs.size() + 1) * n * n);
+    for (auto a : lhs)
+        convert_to_string(txt, *a, true);
     convert_to_string(txt, b, false);
-    int n = a.n;
-    int t = 1000 * n * sqrt((a.entries.size() + b.entries.size()) / n);
-    Lcew ds(txt, t);
+    int t = std::max(1.0, 1000 * n * sqrt((double)nb_entries / n));
+    Lcew ds(std::move(txt), t);
+
+    // A mismatch at offset k of the diagonal from row i of `a` and column j
+    // of `b` is the entry (i + k / n, j + k / n) of the product: the rest of
+    // that row and column can be skipped.
+    vector<int> mism(n);
+    for (size_t s = 0; s < lhs.size(); s++)
+    {
+        if (lhs[s]->entries.empty())
+            continue;
+        auto compute_diag = [&](int i, int j)
+        {
+            int offset = lhs.size() * n * n;
+            int count = ds.diagonal_mismatches(s * n * n + n * i, offset + n * j, n * (n - std::max(i, j)), mism, n);
+            for (int q = 0; q < count; q++)
+                res[s].entries.emplace_back(i + mism[q] / n, j + mism[q] / n);
+        };
+        for (int i = 0; i < n; i++)
+            compute_diag(i, 0);
+
+        for (int j = 1; j < n; j++)
+            compute_diag(0, j);
+
+        std::sort(res[s].entries.begin(), res[s].entries.end());
+    }
+
+    return res;
+}
+
+SparseBoolMatrix matrix_mult(const SparseBoolMatrix &a, const SparseBoolMatrix &b)
+{
+    return std::move(matrix_mult_shared({&a}, b)[0]);
+}
+
+SparseBoolMatrix SparseBoolMatrix::identity(int n)
+{
+    SparseBoolMatrix res;
+    res.n = n;
+    for (int i = 0; i < n; i++)
+        res.entries.emplace_back(i, i);
+    return res;
+}
 
+SparseBoolMatrix SparseBoolMatrix::operator|(const SparseBoolMatrix &other) const
+{
+    assert(n == other.n);
     SparseBoolMatrix res;
     res.n = n;
+    vector<entry> a = entries, b = other.entries;
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(res.entries));
+    res.entries.erase(std::unique(res.entries.begin(), res.entries.end()), res.entries.end());
+    return res;
+}
+
+SparseBoolMatrix SparseBoolMatrix::power(unsigned k) const
+{
+    if (k == 0)
+        return identity(n);
 
-    auto compute_diag = [&](int i, int j)
+    // res = M^(k mod 2^i) and sq = M^(2^i) after i rounds, with res = identity
+    // represented by `first`
+    SparseBoolMatrix res, sq = *this | SparseBoolMatrix{n, {}};
+    bool first = true;
+    while (true)
     {
-        int offset = n * n;
-        int l = 0;
-        while (i + l < n && j + l < n)
-        {
-            int r = ds.lcew(n * (i + l), offset + n * (j + l));
-            l += r / n;
-            if (i + l < n && j + l < n)
-                res.entries.emplace_back(i + l, j + l);
+        bool use = k & 1;
+        k >>= 1;
+        // res * sq and sq * sq share the conversion of sq and the index
+        vector<const SparseBoolMatrix *> lhs;
+        if (use && !first)
+            lhs.push_back(&res);
+        if (k != 0)
+            lhs.push_back(&sq);
+        vector<SparseBoolMatrix> products = matrix_mult_shared(lhs, sq);
 
-            l += 1;
+        if (use)
+        {
+            res = first ? sq : std::move(products[0]);
+            first = false;
         }
-    };
-    for (int i = 0; i < n; i++)
-        compute_diag(i, 0);
+        if (k == 0 || (!first && res.entries.empty()))
+            break;
 
-    for (int j = 1; j < n; j++)
-        compute_diag(0, j);
+        SparseBoolMatrix &next = products.back();
+        // sq^j == sq for all j >= 1: only one product remains
+        if (next == sq)
+            return first ? sq : matrix_mult(res, sq);
+        sq = std::move(next);
+    }
+    return res;
+}
 
-    std::sort(res.entries.begin(), res.entries.end());
+SparseBoolMatrix SparseBoolMatrix::transitive_closure(bool reflexive) const
+{
+    // After round k, `res` contains the paths of length 1 to 2^k
+    SparseBoolMatrix res = *this | SparseBoolMatrix{n, {}};
+    while (true)
+    {
+        SparseBoolMatrix next = res | matrix_mult(res, res);
+        if (next == res)
+            break;
+        res = std::move(next);
+    }
 
+    if (reflexive)
+        res = res | identity(n);
     return res;
 }
 
@@ -20,8 +20,32 @@ public:
     vector<entry> entries;
 
     static SparseBoolMatrix from_dense(vector<vector<bool>> &v);
+    static SparseBoolMatrix identity(int n);
 
-    bool operator==(const SparseBoolMatrix &other)
+    /**
+     * Entries of `*this` or `other`, which must have the same size,
+     * in sorted order.
+     */
+    SparseBoolMatrix operator|(const SparseBoolMatrix &other) const;
+
+    /**
+     * Compute the `k`-th boolean power by repeated squaring.
+     *
+     * Stops squaring early once the squares become zero or stop changing.
+     */
+    SparseBoolMatrix power(unsigned k) const;
+
+    /**
+     * Compute the transitive closure: M+[i, j] is true if and only if
+     * there is a path of length at least 1 from i to j in the graph of M
+     * (or of length at least 0 if `reflexive`).
+     *
+     * Uses `O(log n)` multiplications: each round squares the current
+     * closure, and the iteration stops as soon as it does not change.
+     */
+    SparseBoolMatrix transitive_closure(bool reflexive = false) const;
+
+    bool operator==(const SparseBoolMatrix &other) const
     {
         return other.n == n && other.entries == entries;
     }
@@ -30,5 +54,7 @@ public:
 /**
  * Compute boolean matrix multiplication using a reduction
  * to LCEW.
+ *
+ * The entries of the result are sorted.
  */
 SparseBoolMatrix matrix_mult(const SparseBoolMatrix &a, const SparseBoolMatrix &b);
\ No newline at end of file
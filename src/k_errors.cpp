@@ -0,0 +1,72 @@
+#include "k_errors.hpp"
+#include <climits>
+
+vector<ErrorOccurrence> k_errors(
+    const Lcew &ds, int t_start, int n, int p_start, int m, int k)
+{
+    // L[d] is the last row (prefix length of the pattern) reached on
+    // diagonal d (i.e. in the text at position row + d) with at most e errors.
+    // Diagonals range over [-k, n], shifted by k + 1 to leave room for
+    // a sentinel on each side.
+    const int UNREACHED = INT_MIN / 2;
+    const int shift = k + 1;
+    vector<int> prev(n + k + 3, UNREACHED);
+    vector<int> cur(n + k + 3, UNREACHED);
+    vector<int> best(n + k + 3, -1);
+
+    for (int e = 0; e <= k; e++)
+    {
+        for (int d = -e; d <= n; d++)
+        {
+            int x = d + shift;
+            // An empty prefix of the pattern matches anywhere in the text.
+            int row = (d >= 0) ? 0 : UNREACHED;
+            if (e > 0)
+            {
+                // Substitution, insertion and deletion respectively.
+                row = max({row, prev[x] + 1, prev[x - 1], prev[x + 1] + 1});
+            }
+            row = min({row, m, n - d});
+            if (row < 0)
+            {
+                cur[x] = UNREACHED;
+                continue;
+            }
+
+            if (row < m && row + d < n)
+            {
+                int l = ds.lcew(t_start + row + d, p_start + row);
+                row += min({l, m - row, n - d - row});
+            }
+
+            cur[x] = row;
+            if (row == m && best[x] == -1 && d + m > 0)
+            {
+                best[x] = e;
+            }
+        }
+        swap(prev, cur);
+    }
+
+    vector<ErrorOccurrence> res;
+    for (int d = -k; d <= n - m; d++)
+    {
+        if (best[d + shift] != -1)
+        {
+            res.push_back({d + m - 1, best[d + shift]});
+        }
+    }
+
+    return res;
+}
+
+vector<ErrorOccurrence> k_errors(
+    const vector<int> &pat, const vector<int> &txt, int k, int t,
+    vector<int> wc)
+{
+    vector<int> s(txt);
+    s.insert(s.end(), pat.begin(), pat.end());
+    Lcew ds(s, t, wc);
+
+    return k_errors(ds, 0, txt.size(), txt.size(), pat.size(), k);
+}
@@ -0,0 +1,49 @@
+/**
+ * Approximate pattern matching with edit distance in strings with wildcards,
+ * using LCEW queries in the diagonal transition algorithm of [Landau and Vishkin].
+ */
+
+#pragma once
+
+#include "lcew.hpp"
+#include <vector>
+
+using std::vector;
+
+/**
+ * Occurrence of the pattern in the text with few errors.
+ */
+struct ErrorOccurrence
+{
+    /** Last position of the occurrence in the text. */
+    int end;
+    /** Minimal edit distance between the pattern and a fragment ending at `end`. */
+    int errors;
+
+    bool operator==(const ErrorOccurrence &other) const = default;
+};
+
+/**
+ * Find occurrences with at most `k` errors (substitutions, insertions and
+ * deletions) of a pattern in a text, both indexed in `ds`.
+ *
+ * The text is `T[t_start..t_start + n)` and the pattern `T[p_start..p_start + m)`.
+ * Returns, in increasing order of `end`, all positions `end` such that the
+ * pattern is at edit distance at most `k` from a fragment of the text
+ * ending at `end` (inclusive), with the minimal such distance.
+ * Wildcards match any symbol.
+ *
+ * Uses `O((k + 1) (n + k))` LCEW queries.
+ */
+vector<ErrorOccurrence> k_errors(
+    const Lcew &ds, int t_start, int n, int p_start, int m, int k);
+
+/**
+ * Find occurrences with at most `k` errors of `pat` in `txt`,
+ * using symbols in `wc` as wildcards.
+ *
+ * Builds an LCEW data structure with parameter `t` over `txt` followed by `pat`.
+ */
+vector<ErrorOccurrence> k_errors(
+    const vector<int> &pat, const vector<int> &txt, int k, int t,
+    vector<int> wc = {DEFAULT_WILDCARD});
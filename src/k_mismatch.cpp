@@ -0,0 +1,37 @@
+#include "k_mismatch.hpp"
+
+vector<MismatchOccurrence> k_mismatch(
+    const Lcew &ds, int t_start, int n, int p_start, int m,
+    int k, bool report_pos)
+{
+    vector<MismatchOccurrence> res;
+    MismatchOccurrence occ;
+    // One more than allowed, to tell alignments with too many mismatches apart
+    vector<int> mism(k + 1);
+    for (int i = 0; i + m <= n; i++)
+    {
+        int count = ds.diagonal_mismatches(t_start + i, p_start, m, mism);
+        if (count > k)
+            continue;
+
+        occ.pos = i;
+        occ.mismatches = count;
+        occ.mism_pos.clear();
+        if (report_pos)
+            occ.mism_pos.assign(mism.begin(), mism.begin() + count);
+        res.push_back(occ);
+    }
+
+    return res;
+}
+
+vector<MismatchOccurrence> k_mismatch(
+    const vector<int> &pat, const vector<int> &txt, int k, int t,
+    vector<int> wc, bool report_pos)
+{
+    vector<int> s(txt);
+    s.insert(s.end(), pat.begin(), pat.end());
+    Lcew ds(s, t, wc);
+
+    return k_mismatch(ds, 0, txt.size(), txt.size(), pat.size(), k, report_pos);
+}
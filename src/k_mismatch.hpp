@@ -0,0 +1,51 @@
+/**
+ * Pattern matching with mismatches in strings with wildcards,
+ * using LCEW queries as "kangaroo jumps" [Landau and Vishkin].
+ */
+
+#pragma once
+
+#include "lcew.hpp"
+#include <vector>
+
+using std::vector;
+
+/**
+ * Alignment of the pattern in the text with few mismatches.
+ */
+struct MismatchOccurrence
+{
+    /** Starting position of the alignment in the text. */
+    int pos;
+    int mismatches;
+    /** Positions (in the pattern) of the mismatches, if requested. */
+    vector<int> mism_pos;
+
+    bool operator==(const MismatchOccurrence &other) const = default;
+};
+
+/**
+ * Find alignments with at most `k` mismatches of a pattern
+ * in a text, both indexed in `ds`.
+ *
+ * The text is `T[t_start..t_start + n)` and the pattern `T[p_start..p_start + m)`.
+ * Returns, in increasing order of position, all `i` such that the pattern
+ * and `T[t_start + i..t_start + i + m)` differ in at most `k` positions
+ * that are not wildcards.
+ * If `report_pos` is true, also reports the positions of the mismatches.
+ *
+ * Uses `O((k + 1) n)` LCEW queries.
+ */
+vector<MismatchOccurrence> k_mismatch(
+    const Lcew &ds, int t_start, int n, int p_start, int m,
+    int k, bool report_pos = false);
+
+/**
+ * Find alignments with at most `k` mismatches of `pat` in `txt`,
+ * using symbols in `wc` as wildcards.
+ *
+ * Builds an LCEW data structure with parameter `t` over `txt` followed by `pat`.
+ */
+vector<MismatchOccurrence> k_mismatch(
+    const vector<int> &pat, const vector<int> &txt, int k, int t,
+    vector<int> wc = {DEFAULT_WILDCARD}, bool report_pos = false);
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "stats.hpp"
+#include <vector>
+#include <random>
+#include <cstdint>
+
+using std::vector;
+
+/**
+ * Data structure for LCE queries in a text T using Karp-Rabin fingerprints.
+ *
+ * Stores the fingerprint of every `sample`-th prefix of `T`, i.e.
+ * `n / sample` words, and answers queries in `O(sample * log l)` time
+ * by exponential and binary search on the length `l` of the LCE.
+ * Queries are correct with high probability: the base is drawn at random
+ * and fingerprints are computed modulo the prime `2^61 - 1`.
+ */
+class KrLce
+{
+private:
+    static constexpr uint64_t MOD = (1ULL << 61) - 1;
+
+    int n;
+    int sample;
+    uint64_t base;
+    /** `base^(2^k)` for all `k`. */
+    uint64_t pow2[32];
+    /** `fp[q]` is the fingerprint of `T[0..q * sample)`. */
+    vector<uint64_t> fp;
+
+    static uint64_t mul(uint64_t a, uint64_t b)
+    {
+        __uint128_t x = (__uint128_t)a * b;
+        uint64_t res = (uint64_t)(x & MOD) + (uint64_t)(x >> 61);
+        return res >= MOD ? res - MOD : res;
+    }
+
+    static uint64_t sub(uint64_t a, uint64_t b)
+    {
+        return a >= b ? a - b : a + MOD - b;
+    }
+
+    uint64_t extend(uint64_t h, int c) const
+    {
+        uint64_t res = mul(h, base) + (uint32_t)c + 1;
+        return res >= MOD ? res - MOD : res;
+    }
+
+    /**
+     * `base^e`, for `0 <= e < 2^31`.
+     */
+    uint64_t power(int e) const
+    {
+        uint64_t res = 1;
+        for (int k = 0; e; k++, e >>= 1)
+            if (e & 1)
+                res = mul(res, pow2[k]);
+        return res;
+    }
+
+    /**
+     * Fingerprint of `T[0..i)`.
+     */
+    uint64_t prefix(const vector<int> &s, int i) const
+    {
+        int q = i / sample;
+        uint64_t h = fp[q];
+        for (int k = q * sample; k < i; k++)
+            h = extend(h, s[k]);
+        return h;
+    }
+
+    /**
+     * Length of the longest common prefix, at most `max_l`, of `A[a..]` and
+     * `B[b..]`, where `fa(x)` and `fb(x)` are the fingerprints of `A[0..x)`
+     * and `B[0..x)`, by exponential and binary search.
+     */
+    template <class Fa, class Fb>
+    int common_prefix(Fa fa, Fb fb, int a, int b, int max_l) const
+    {
+        uint64_t ha = fa(a), hb = fb(b);
+        int l = 0, k = 0;
+
+        auto try_extend = [&](int k) -> bool
+        {
+            if (k > 30)
+                return false;
+            int len = 1 << k;
+            if (l + len > max_l)
+                return false;
+            uint64_t ha2 = fa(a + l + len), hb2 = fb(b + l + len);
+            if (sub(ha2, mul(ha, pow2[k])) != sub(hb2, mul(hb, pow2[k])))
+                return false;
+            ha = ha2;
+            hb = hb2;
+            l += len;
+            return true;
+        };
+
+        while (try_extend(k))
+            k++;
+        while (--k >= 0)
+            try_extend(k);
+
+        return l;
+    }
+
+    /**
+     * Length of the longest common suffix, at most `max_l`, of `A[..a)` and
+     * `B[..b)`, with `fa` and `fb` as in `common_prefix`.
+     */
+    template <class Fa, class Fb>
+    int common_suffix(Fa fa, Fb fb, int a, int b, int max_l) const
+    {
+        uint64_t ha = fa(a), hb = fb(b);
+        int l = 0, k = 0;
+
+        auto try_extend = [&](int k) -> bool
+        {
+            if (k > 30)
+                return false;
+            int len = 1 << k;
+            if (l + len > max_l)
+                return false;
+            uint64_t ha2 = fa(a - l - len), hb2 = fb(b - l - len);
+            if (sub(ha, mul(ha2, pow2[k])) != sub(hb, mul(hb2, pow2[k])))
+                return false;
+            ha = ha2;
+            hb = hb2;
+            l += len;
+            return true;
+        };
+
+        while (try_extend(k))
+            k++;
+        while (--k >= 0)
+            try_extend(k);
+
+        return l;
+    }
+
+public:
+    /**
+     * Build the data structure for the text `s`, keeping one fingerprint
+     * every `sample` positions.
+     */
+    KrLce(const vector<int> &s, int sample = 1) : n(s.size()), sample(sample)
+    {
+        std::mt19937_64 rng(std::random_device{}());
+        base = std::uniform_int_distribution<uint64_t>(1 << 20, MOD - 1)(rng);
+        pow2[0] = base;
+        for (int k = 1; k < 32; k++)
+            pow2[k] = mul(pow2[k - 1], pow2[k - 1]);
+
+        fp.reserve(n / sample + 1);
+        uint64_t h = 0;
+        for (int i = 0; i <= n; i++)
+        {
+            if (i % sample == 0)
+                fp.push_back(h);
+            if (i < n)
+                h = extend(h, s[i]);
+        }
+    }
+
+    /**
+     * Query the value of the LCE of `T[i..]` and `T[j..]`,
+     * where `s` is the text the data structure was built for.
+     */
+    int lce(const vector<int> &s, int i, int j) const
+    {
+        if (i == j)
+            return n - i;
+
+        auto text = [&](int x)
+        { return prefix(s, x); };
+        return common_prefix(text, text, i, j, n - std::max(i, j));
+    }
+
+    /**
+     * Query the length of the longest common suffix of `T[..i]` and `T[..j]`
+     * (both included), where `s` is the text the data structure was built for.
+     */
+    int lcs(const vector<int> &s, int i, int j) const
+    {
+        if (i == j)
+            return i + 1;
+
+        auto text = [&](int x)
+        { return prefix(s, x); };
+        return common_suffix(text, text, i + 1, j + 1, std::min(i, j) + 1);
+    }
+
+    /**
+     * Fingerprints of all the prefixes of `p`, with the same base as the
+     * text, for comparisons with `lce` below.
+     */
+    vector<uint64_t> prefix_fingerprints(const vector<int> &p) const
+    {
+        vector<uint64_t> res(p.size() + 1, 0);
+        for (size_t k = 0; k < p.size(); k++)
+            res[k + 1] = extend(res[k], p[k]);
+        return res;
+    }
+
+    /**
+     * Length of the longest common prefix, at most `max_l`, of `T[i..]` and
+     * `P[j..]`, where `s` is the text and `p_fp` holds the fingerprints of the
+     * prefixes of `P` (see `prefix_fingerprints`).
+     */
+    int lce(const vector<int> &s, int i, const vector<uint64_t> &p_fp, int j, int max_l) const
+    {
+        max_l = std::min({max_l, n - i, (int)p_fp.size() - 1 - j});
+        return common_prefix([&](int x)
+                             { return prefix(s, x); },
+                             [&](int x)
+                             { return p_fp[x]; },
+                             i, j, max_l);
+    }
+
+    /**
+     * Update the fingerprints after the substitution of `old_symbol` by
+     * `s[pos]`, where `s` is the updated text, in `O(n / sample)` time.
+     */
+    void update(const vector<int> &s, int pos, int old_symbol)
+    {
+        // T[pos] contributes (T[pos] + 1) * base^(q * sample - 1 - pos) to fp[q]
+        uint64_t delta = sub((uint32_t)s[pos] + 1ULL, (uint32_t)old_symbol + 1ULL);
+        int q = pos / sample + 1;
+        if (q >= (int)fp.size())
+            return;
+        uint64_t h = mul(delta, power(q * sample - 1 - pos));
+        uint64_t step = power(sample);
+        for (; q < (int)fp.size(); q++)
+        {
+            fp[q] += h;
+            if (fp[q] >= MOD)
+                fp[q] -= MOD;
+            h = mul(h, step);
+        }
+    }
+
+    /**
+     * Memory used by the data structure, in bytes.
+     */
+    size_t memory_usage() const
+    {
+        return sizeof(pow2) + fp.capacity() * sizeof(uint64_t);
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ukkonen.hpp"
+#include "stats.hpp"
 #include <vector>
 
 using std::vector;
@@ -19,14 +20,27 @@ private:
     vector<vector<int>> mem;
 
 public:
-    Lce(vector<int> &s)
+    /**
+     * Build the data structure for the text `s`.
+     *
+     * If `stats` is not null and `LCEW_STATS` is defined, the time spent
+     * building the suffix structure and the RMQ is added to `*stats`.
+     */
+    Lce(vector<int> &s, [[maybe_unused]] BuildStats *stats = nullptr)
     {
         s.push_back(-1);
         int n = s.size();
 
         SuffixTree st;
-        st.Create_suffix_tree(&s, n);
-        st.Compute_suffix_arrays();
+        {
+            LCEW_STATS_ONLY(PhaseTimer timer(stats ? &stats->suffix_structure : nullptr));
+            st.Create_suffix_tree(&s, n);
+            st.Compute_suffix_arrays();
+        }
+        {
+            LCEW_STATS_ONLY(PhaseTimer timer(stats ? &stats->rmq : nullptr));
+            st.Compute_RMQ();
+        }
         isa = std::move(st.RANK);
         mem = std::move(st.DBF);
         st.Delete_suffix_tree();
@@ -48,4 +62,15 @@ public:
         int level = 8 * sizeof(int) - 1 - __builtin_clz(j1 - i1);
         return std::min(mem[level][i1], mem[level][j1 - (1 << level)]);
     }
+
+    /**
+     * Memory used by the data structure, in bytes.
+     */
+    size_t memory_usage() const
+    {
+        size_t res = isa.capacity() * sizeof(int);
+        for (auto &row : mem)
+            res += sizeof(row) + row.capacity() * sizeof(int);
+        return res;
+    }
 };
\ No newline at end of file
@@ -1,166 +1,354 @@
 #include "lcew.hpp"
 #include "pm_wc.hpp"
+#include <optional>
+#include <random>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    thread_local QueryStats last_query;
+    thread_local QueryStats thread_total;
+
+    /**
+     * Entries of a lazy jump table with a memory cap computed by the last
+     * walk of the thread: entry `(first_row + k, cols[k])` is `values[k]`.
+     *
+     * The next hops of a query follow the same walk, so they find their
+     * entries here when the rows could not be kept within the cap.
+     */
+    struct LastWalk
+    {
+        /** `LazyJump::version` of the table, 0 for none. */
+        size_t version = 0;
+        int first_row = 0;
+        vector<int> cols, values;
+    };
+    thread_local LastWalk last_walk;
+    /** Source of the `LazyJump::version` numbers. */
+    std::atomic<size_t> lazy_versions = 0;
+}
 
 /**
- * Compute the dynamic programming table used by the LCEW data structure.
- *
- * Refer to the paper for more detail.
+ * Fill row `r` of the dynamic programming table used by the LCEW data structure,
+ * given the occurrences `occ` of the block between the selected positions
+ * `r` and `r + 1`. Row `r + 1` must already be filled.
  */
-vector<vector<int>> compute_jump(vector<int> &t, unordered_set<int> &wc, vector<int> &selected_pos)
+void fill_jump_row(
+    vector<vector<int>> &jump, int r, const vector<bool> &occ,
+    vector<int> &t, unordered_set<int> &wc, vector<int> &selected_pos)
 {
     int n = t.size();
-    int sigma = selected_pos.size();
 
     auto matches = [&](int i, int j) -> bool
     {
         return t[i] == t[j] || wc.contains(t[i]) || wc.contains(t[j]);
     };
 
-    vector<vector<bool>> occs;
-    for (int i = 0; i < sigma - 1; i++)
+    for (int j = 0; j < n; ++j)
     {
-        vector<int> p(t.begin() + selected_pos[i], t.begin() + selected_pos[i + 1] + 1);
-        auto tmp = pm_wc(p, t, wc);
-        occs.push_back(tmp);
+        int lr = selected_pos[r + 1] - selected_pos[r];
+        if (j + lr < n && matches(selected_pos[r], j) && occ[j])
+        {
+            jump[r][j] = std::max(0, selected_pos[r + 1] - selected_pos[r] - jump[r + 1][j + lr]);
+        }
+        else
+        {
+            jump[r][j] = 0;
+        }
     }
+}
 
-    vector<vector<int>> jump(sigma, vector<int>(n, 0));
-    for (int r = sigma - 2; r >= 0; --r)
+/**
+ * Check for an occurrence of the block `T[start..start + len)` at position `j`,
+ * skipping the runs of wildcards of the block in one step with `transitions`.
+ *
+ * Adds the number of steps made to `steps`.
+ */
+inline bool block_occurs_at(
+    const vector<int> &t, const vector<char> &is_wc, const BitVector &transitions,
+    int start, int len, int j, long long &steps)
+{
+    int k = 0;
+    while (k < len)
     {
-        for (int j = 0; j < n; ++j)
-        {
-            int lr = selected_pos[r + 1] - selected_pos[r];
-            if (j + lr < n && matches(selected_pos[r], j) && occs[r][j])
-            {
-                jump[r][j] = std::max(0, selected_pos[r + 1] - selected_pos[r] - jump[r + 1][j + lr]);
-            }
-            else
-            {
-                jump[r][j] = 0;
-            }
-        }
+        steps++;
+        if (is_wc[start + k])
+            k += std::max(1, transitions.distance_to_next(start + k));
+        else if (t[start + k] == t[j + k] || is_wc[j + k])
+            k++;
+        else
+            return false;
     }
+    return true;
+}
 
-    return jump;
+/**
+ * Occurrences of the block `T[start..start + len)` in `T`, by direct comparison,
+ * written to `occ`.
+ */
+void scan_occurrences(
+    const vector<int> &t, const vector<char> &is_wc, const BitVector &transitions,
+    int start, int len, vector<bool> &occ)
+{
+    int n = t.size();
+    occ.assign(n, false);
+    long long steps = 0;
+    for (int j = 0; j + len <= n; j++)
+        occ[j] = block_occurs_at(t, is_wc, transitions, start, len, j, steps);
 }
 
-vector<vector<int>> compute_jump2(
-    vector<int> &t, unordered_set<int> &wc,
-    vector<int> &selected_pos, vector<int> &next_tr)
+/**
+ * Estimated time, in nanoseconds, of `scan_occurrences` for the block
+ * `T[start..start + len)`.
+ *
+ * Extrapolated from the number of steps made at a few random positions,
+ * which accounts for both the runs of wildcards of the block and for
+ * the repetitiveness of the text.
+ */
+double scan_cost(
+    const vector<int> &t, const vector<char> &is_wc, const BitVector &transitions,
+    int start, int len, std::minstd_rand &rng)
 {
+    const int SAMPLES = 32;
     int n = t.size();
-    int sigma = selected_pos.size();
+    int nb_pos = n - len + 1;
+    long long steps = 0;
+    std::uniform_int_distribution<int> pos(0, nb_pos - 1);
+    for (int s = 0; s < SAMPLES; s++)
+        block_occurs_at(t, is_wc, transitions, start, len, pos(rng), steps);
 
-    auto matches = [&](int i, int j) -> bool
-    {
-        return t[i] == t[j] || wc.contains(t[i]) || wc.contains(t[j]);
-    };
+    // Rough cost per step, measured on a x86-64 machine
+    return 2.0 * nb_pos * ((double)steps / SAMPLES + 1);
+}
 
-    vector<vector<bool>> occs;
-    for (int i = 0; i < sigma - 1; i++)
+/**
+ * Occurrences of the block `T[start..start + len)` in `T`, written to `occ`.
+ *
+ * With `OccurrenceMethod::Auto`, they are found by whichever of `pm_wc`
+ * and `scan_occurrences` has the lower estimated cost.
+ * The transforms of the text used by `pm_wc` are computed in `text` on first use.
+ */
+void block_occurrences(
+    const vector<int> &t, const unordered_set<int> &wc, const vector<char> &is_wc,
+    const BitVector &transitions, int start, int len, OccurrenceMethod method,
+    std::minstd_rand &rng, std::optional<PmWcText> &text, vector<bool> &occ)
+{
+    int n = t.size();
+    bool scan = method == OccurrenceMethod::Scan ||
+                (method == OccurrenceMethod::Auto &&
+                 scan_cost(t, is_wc, transitions, start, len, rng) < pm_wc_cost(len, n));
+    if (scan)
+    {
+        scan_occurrences(t, is_wc, transitions, start, len, occ);
+    }
+    else
     {
-        int l_p = selected_pos[i + 1] - selected_pos[i] + 1;
-        auto tmp = pm_wc_jump(selected_pos[i], l_p, t, wc, next_tr);
-        occs.push_back(tmp);
+        if (!text)
+            text.emplace(t, wc);
+        pm_wc(std::span<const int>(t).subspan(start, len), *text, occ);
     }
+}
+
+/**
+ * Compute the dynamic programming table used by the LCEW data structure.
+ *
+ * Refer to the paper for more detail.
+ *
+ * Rows are computed from last to first, each right after the occurrences
+ * of its block, so that only one occurrence vector is alive at a time.
+ */
+vector<vector<int>> compute_jump(
+    vector<int> &t, unordered_set<int> &wc, vector<int> &selected_pos,
+    const BitVector &transitions, OccurrenceMethod method, [[maybe_unused]] BuildStats &stats)
+{
+    int n = t.size();
+    int sigma = selected_pos.size();
+
+    vector<char> is_wc(n);
+    for (int i = 0; i < n; i++)
+        is_wc[i] = wc.contains(t[i]);
+    std::minstd_rand rng(n);
 
     vector<vector<int>> jump(sigma, vector<int>(n, 0));
+    std::optional<PmWcText> text;
+    // Reused from one block to the next
+    vector<bool> occ;
     for (int r = sigma - 2; r >= 0; --r)
     {
-        for (int j = 0; j < n; ++j)
         {
-            int lr = selected_pos[r + 1] - selected_pos[r];
-            if (j + lr < n && matches(selected_pos[r], j) && occs[r][j])
-            {
-                jump[r][j] = std::max(0, selected_pos[r + 1] - selected_pos[r] - jump[r + 1][j + lr]);
-            }
-            else
-            {
-                jump[r][j] = 0;
-            }
+            LCEW_STATS_ONLY(PhaseTimer timer(&stats.occurrences));
+            int start = selected_pos[r], len = selected_pos[r + 1] - selected_pos[r] + 1;
+            block_occurrences(t, wc, is_wc, transitions, start, len, method, rng, text, occ);
         }
+
+        LCEW_STATS_ONLY(PhaseTimer timer(&stats.jump_dp));
+        fill_jump_row(jump, r, occ, t, wc, selected_pos);
     }
 
     return jump;
 }
 
-Lcew::Lcew(vector<int> txt, int t, vector<int> wc) : text(txt), sa(txt)
+std::variant<Lce, KrLce> Lcew::build_lce(vector<int> &txt, const LcewOptions &opts, BuildStats *stats)
 {
-    this->wildcards = unordered_set(wc.begin(), wc.end());
-    int n = text.size();
-    next_tr = vector(n, 0);
-    for (int i = n - 2; i >= 0; --i)
+    if (opts.backend == LceBackend::Fingerprint)
     {
-        if (i > 0 && wildcards.contains(text[i - 1]) && !wildcards.contains(text[i]))
-        {
-            next_tr[i] = 0;
-        }
-        else
-        {
-            next_tr[i] = next_tr[i + 1] + 1;
-        }
+        LCEW_STATS_ONLY(PhaseTimer timer(&stats->suffix_structure));
+        return KrLce(txt, opts.sample);
     }
 
+    return Lce(txt, stats);
+}
+
+Lcew::Lcew(vector<int> txt, int t, vector<int> wc, LcewOptions opts)
+    : text(txt), options(opts), sa(build_lce(txt, opts, &stats))
+{
+    this->wildcards = unordered_set(wc.begin(), wc.end());
+    this->wc_list = vector(wildcards.begin(), wildcards.end());
     assert(t > 0);
+    build_direction(fwd, text, t);
+
+    if (opts.backward)
+    {
+        vector<int> reversed(text.rbegin(), text.rend());
+        if (opts.backend == LceBackend::SuffixTree)
+            reverse_sa = std::make_unique<Lce>(reversed, &stats);
+        build_direction(bwd, reversed, t);
+    }
+}
+
+void Lcew::build_direction(Direction &d, vector<int> &txt, int t)
+{
+    LCEW_STATS_ONLY(PhaseTimer nav_timer(&stats.navigation));
+    int n = txt.size();
+    vector<bool> tr_bits(n);
+    for (int i = 1; i < n - 1; i++)
+        tr_bits[i] = wildcards.contains(txt[i - 1]) && !wildcards.contains(txt[i]);
+    tr_bits[n - 1] = true;
+    d.transitions = BitVector(tr_bits);
 
     vector<int> selected_pos;
-    next_sel = vector(n, 1);
+    vector<bool> sel_bits(n);
     int tr_count = 0;
     for (int i = 0; i < n - 1; i++)
     {
-        if (next_tr[i] == 0)
+        if (tr_bits[i])
         {
             if (tr_count == 0)
             {
                 selected_pos.push_back(i);
-                next_sel[i] = 0;
+                sel_bits[i] = true;
             }
 
             tr_count = (tr_count + 1) % t;
         }
     }
     selected_pos.push_back(n - 1);
-    next_sel[n - 1] = 0;
+    sel_bits[n - 1] = true;
+    d.selected = BitVector(sel_bits);
+    LCEW_STATS_ONLY(nav_timer.stop());
+
+    if (options.lazy_jump)
+    {
+        auto &lazy = d.lazy;
+        lazy = std::make_shared<LazyJump>();
+        lazy->version = ++lazy_versions;
+        lazy->rows.resize(selected_pos.size());
+        lazy->published = vector<std::atomic<LazyJump::Row *>>(selected_pos.size());
+        size_t row_size = n * sizeof(int);
+        lazy->max_rows = options.jump_memory_cap == 0 ? 0 : std::max((size_t)1, options.jump_memory_cap / row_size);
+        lazy->selected_pos = std::move(selected_pos);
+        return;
+    }
 
-    for (int i = n - 2; i >= 0; --i)
+    d.jump = compute_jump(txt, wildcards, selected_pos, d.transitions, options.occurrences, stats);
+}
+
+template <bool Backward>
+int Lcew::scan_window(int i, int j, int w) const
+{
+    // Position i + q is a[q] forward and a[-q] backward
+    int n = text.size();
+    const int *a = text.data() + (Backward ? n - 1 - i : i);
+    const int *b = text.data() + (Backward ? n - 1 - j : j);
+    int q = 0;
+
+#ifdef __SSE2__
+    if (wc_list.size() <= SIMD_MAX_WILDCARDS)
     {
-        if (next_sel[i] != 0)
+        const __m128i ones = _mm_set1_epi32(-1);
+        for (; q + 4 <= w; q += 4)
         {
-            next_sel[i] = next_sel[i + 1] + 1;
+            __m128i x, y;
+            if constexpr (Backward)
+            {
+                // Reverse the lanes, to keep them in increasing order of q
+                x = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a - q - 3)), _MM_SHUFFLE(0, 1, 2, 3));
+                y = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b - q - 3)), _MM_SHUFFLE(0, 1, 2, 3));
+            }
+            else
+            {
+                x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + q));
+                y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + q));
+            }
+            __m128i stop = _mm_xor_si128(_mm_cmpeq_epi32(x, y), ones);
+            for (int c : wc_list)
+            {
+                __m128i v = _mm_set1_epi32(c);
+                stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi32(x, v), _mm_cmpeq_epi32(y, v)));
+            }
+
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(stop));
+            if (mask != 0)
+                return q + __builtin_ctz(mask);
         }
     }
+#endif
 
-    sel_rank = vector(n, INT32_MAX);
-    for (size_t i = 0; i < selected_pos.size(); i++)
+    for (; q < w; q++)
     {
-        sel_rank[selected_pos[i]] = i;
+        if (at<Backward>(i + q) != at<Backward>(j + q) || is_wildcard<Backward>(i + q) || is_wildcard<Backward>(j + q))
+            return q;
     }
 
-    jump = compute_jump(text, wildcards, selected_pos);
-    // jump = compute_jump2(text, wildcards, selected_pos, next_tr);
+    return q;
 }
 
-int Lcew::next_selected_or_mism(int i, int j) const
+template <bool Backward>
+int Lcew::next_selected_or_mism(int i, int j, int m) const
 {
     int r = 0;
-    int m = min(next_sel[i], next_sel[j]);
 
-    while (matches(i + r, j + r) && !(is_selected(i + r) || is_selected(j + r)))
+    while (matches<Backward>(i + r, j + r) && !(is_selected<Backward>(i + r) || is_selected<Backward>(j + r)))
     {
-        r += sa.lce(i + r, j + r);
+        // Mismatches and wildcards are usually close: look for them directly
+        // before resorting to an LCE query, which costs a few cache misses.
+        int k = scan_window<Backward>(i + r, j + r, min(m - r, SCAN_WINDOW));
+        if (k < SCAN_WINDOW)
+        {
+            r += k;
+        }
+        else
+        {
+            r += lce<Backward>(i + r, j + r);
+            LCEW_STATS_ONLY(++last_query.lce_calls);
+        }
         // Do not go over the first selected position
         r = min(r, m);
 
         // If either is a wildcard, move to the end of the block of wildcards.
         int jmp = 0;
-        if (is_wildcard(i + r))
+        if (is_wildcard<Backward>(i + r))
         {
-            jmp = max(jmp, next_tr[i + r]);
+            jmp = max(jmp, next_tr<Backward>(i + r));
         }
-        if (is_wildcard(j + r))
+        if (is_wildcard<Backward>(j + r))
         {
-            jmp = max(jmp, next_tr[j + r]);
+            jmp = max(jmp, next_tr<Backward>(j + r));
         }
+        LCEW_STATS_ONLY(last_query.wildcard_skips += jmp > 0);
         r += jmp;
         // Do not go over the first selected position
         r = min(r, m);
@@ -169,28 +357,441 @@ int Lcew::next_selected_or_mism(int i, int j) const
     return r;
 }
 
+int Lcew::lazy_entry(LazyJump &lazy, int r, int j) const
+{
+    if (lazy.max_rows == 0)
+    {
+        // Rows are never freed once published
+        LazyJump::Row *row = lazy.published[r].load(std::memory_order_acquire);
+        return row ? (*row)[j].load(std::memory_order_relaxed) : LazyJump::UNKNOWN;
+    }
+
+    std::lock_guard lock(lazy.mtx);
+    auto &row = lazy.rows[r];
+    return row ? (*row)[j].load(std::memory_order_relaxed) : LazyJump::UNKNOWN;
+}
+
+void Lcew::store_lazy_entry(LazyJump &lazy, int r, int j, int value, bool evict) const
+{
+    if (lazy.max_rows == 0)
+    {
+        if (LazyJump::Row *row = lazy.published[r].load(std::memory_order_acquire))
+        {
+            (*row)[j].store(value, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    std::lock_guard lock(lazy.mtx);
+    auto &row = lazy.rows[r];
+    if (!row)
+    {
+        if (lazy.max_rows != 0 && lazy.allocated.size() >= lazy.max_rows)
+        {
+            if (!evict)
+                return;
+            lazy.rows[lazy.allocated.front()] = nullptr;
+            lazy.allocated.pop_front();
+        }
+
+        row = std::make_unique<LazyJump::Row>(text.size());
+        for (auto &x : *row)
+            x.store(LazyJump::UNKNOWN, std::memory_order_relaxed);
+        if (lazy.max_rows == 0)
+            lazy.published[r].store(row.get(), std::memory_order_release);
+        else
+            lazy.allocated.push_back(r);
+    }
+    (*row)[j].store(value, std::memory_order_relaxed);
+}
+
+template <bool Backward>
+bool Lcew::block_occurs_at(int start, int len, int j) const
+{
+    int k = 0;
+    while (k < len)
+    {
+        k += lce<Backward>(start + k, j + k);
+        if (k >= len)
+            break;
+        if (is_wildcard<Backward>(start + k))
+            k += std::max(1, next_tr<Backward>(start + k));
+        else if (is_wildcard<Backward>(j + k))
+            k += std::max(1, next_tr<Backward>(j + k));
+        else
+            return false;
+    }
+    return true;
+}
+
+template <bool Backward>
+int Lcew::lazy_jump_at(int r, int j) const
+{
+    LazyJump &lazy = *dir<Backward>().lazy;
+    int n = text.size();
+    int last = lazy.selected_pos.size() - 1;
+
+    auto known = [&](int r, int j)
+    {
+        int k = r - last_walk.first_row;
+        if (lazy.max_rows != 0 && last_walk.version == lazy.version &&
+            k >= 0 && k < (int)last_walk.cols.size() && last_walk.cols[k] == j)
+            return last_walk.values[k];
+        return lazy_entry(lazy, r, j);
+    };
+
+    // Follow the entries (r, j), (r + 1, j + l_r), ... up to a known one,
+    // as in `fill_jump_row`, then store them back to front. No row is held
+    // during the walk; with a memory cap, the entries of the chain only
+    // fill the free rows, and only the entry asked for may evict a row.
+    vector<std::pair<int, int>> chain;
+    int value = 0;
+    while (r < last)
+    {
+        int v = known(r, j);
+        if (v != LazyJump::UNKNOWN)
+        {
+            value = v;
+            break;
+        }
+
+        int lr = lazy.selected_pos[r + 1] - lazy.selected_pos[r];
+        if (j + lr >= n || !block_occurs_at<Backward>(lazy.selected_pos[r], lr + 1, j))
+        {
+            store_lazy_entry(lazy, r, j, 0, chain.empty());
+            value = 0;
+            break;
+        }
+        chain.emplace_back(r, j);
+        r++;
+        j += lr;
+    }
+
+    vector<int> values(chain.size());
+    for (int k = chain.size() - 1; k >= 0; k--)
+    {
+        auto [cr, cj] = chain[k];
+        int lr = lazy.selected_pos[cr + 1] - lazy.selected_pos[cr];
+        value = values[k] = std::max(0, lr - value);
+        store_lazy_entry(lazy, cr, cj, value, k == 0);
+    }
+    if (lazy.max_rows != 0 && !chain.empty())
+    {
+        last_walk.version = lazy.version;
+        last_walk.first_row = chain[0].first;
+        last_walk.cols.resize(chain.size());
+        for (size_t k = 0; k < chain.size(); k++)
+            last_walk.cols[k] = chain[k].second;
+        last_walk.values = std::move(values);
+    }
+    return value;
+}
+
+vector<int> Lcew::find(const vector<int> &pattern) const
+{
+    int n = text.size(), m = pattern.size();
+    vector<int> res;
+    if (m > n)
+        return res;
+
+    // Length of the run of wildcards or of the run of other symbols
+    // of the pattern starting at k
+    vector<char> p_wc(m);
+    vector<int> run(m + 1, 0);
+    for (int k = m - 1; k >= 0; --k)
+    {
+        p_wc[k] = wildcards.contains(pattern[k]);
+        run[k] = k + 1 < m && p_wc[k + 1] == p_wc[k] ? run[k + 1] + 1 : 1;
+    }
+
+    auto *kr = std::get_if<KrLce>(&sa);
+    if (!kr)
+    {
+        // The suffix tree cannot compare the text with the pattern, and
+        // comparing symbol by symbol would take O(nm) time
+        vector<bool> occ = pm_wc(pattern, text, wildcards);
+        for (int i = 0; i + m <= n; i++)
+            if (occ[i])
+                res.push_back(i);
+        return res;
+    }
+
+    vector<uint64_t> p_fp = kr->prefix_fingerprints(pattern);
+    // Longest common prefix of T[x..] and P[k..k + len), without wildcards in P
+    auto common = [&](int x, int k, int len) -> int
+    {
+        return len == 0 ? 0 : kr->lce(text, x, p_fp, k, len);
+    };
+
+    for (int i = 0; i + m <= n; i++)
+    {
+        int k = 0;
+        while (k < m)
+        {
+            if (p_wc[k])
+                k += run[k];
+            else if (is_wildcard(i + k))
+                k += std::max(1, next_tr(i + k));
+            else if (text[i + k] != pattern[k])
+                break;
+            else
+                k += 1 + common(i + k + 1, k + 1, run[k] - 1);
+        }
+        if (k >= m)
+            res.push_back(i);
+    }
+    return res;
+}
+
+vector<int> Lcew::selected_positions(const Direction &d) const
+{
+    if (d.lazy)
+        return d.lazy->selected_pos;
+
+    vector<int> res(d.selected.ones());
+    for (size_t k = 0; k < res.size(); k++)
+        res[k] = d.selected.select(k);
+    return res;
+}
+
+void Lcew::update(int pos, int symbol)
+{
+    int n = text.size();
+    assert(0 <= pos && pos < n);
+    int old_symbol = text[pos];
+    if (old_symbol == symbol)
+        return;
+    text[pos] = symbol;
+
+    if (auto *kr = std::get_if<KrLce>(&sa))
+    {
+        kr->update(text, pos, old_symbol);
+    }
+    else
+    {
+        sa = build_lce(text, options, &stats);
+        if (reverse_sa)
+        {
+            vector<int> reversed(text.rbegin(), text.rend());
+            reverse_sa = std::make_unique<Lce>(reversed, &stats);
+        }
+    }
+
+    repair<false>(pos);
+    if (options.backward)
+        repair<true>(n - 1 - pos);
+}
+
+template <bool Backward>
+void Lcew::repair(int pos)
+{
+    int n = text.size();
+    Direction &d = Backward ? bwd : fwd;
+    auto &lazy = d.lazy;
+    auto &jump = d.jump;
+
+    // Only the positions pos and pos + 1 may start or stop being transitions
+    for (int i = std::max(pos, 1); i <= std::min(pos + 1, n - 2); i++)
+        d.transitions.set(i, is_wildcard<Backward>(i - 1) && !is_wildcard<Backward>(i));
+
+    if (lazy)
+    {
+        // Entries depend on the entries of the next rows: discard them all
+        std::lock_guard lock(lazy->mtx);
+        for (size_t r = 0; r < lazy->rows.size(); r++)
+        {
+            lazy->rows[r] = nullptr;
+            lazy->published[r].store(nullptr, std::memory_order_relaxed);
+        }
+        lazy->allocated.clear();
+        lazy->version = ++lazy_versions;
+        return;
+    }
+
+    vector<int> selected_pos = selected_positions(d);
+    int sigma = selected_pos.size();
+    // Built on first use, when the block of a row contains pos,
+    // with the text in the direction of the queries
+    vector<int> reversed;
+    vector<char> is_wc;
+    std::optional<PmWcText> pm_text;
+    std::minstd_rand rng(n);
+    vector<bool> occ;
+
+    // Positions of the entries that changed in the row below, and in this row
+    vector<int> changed, changed_row, candidates;
+    for (int r = sigma - 2; r >= 0; --r)
+    {
+        int start = selected_pos[r], lr = selected_pos[r + 1] - start;
+        auto set_entry = [&](int j, bool occurs)
+        {
+            int value = occurs ? std::max(0, lr - jump[r + 1][j + lr]) : 0;
+            if (value != jump[r][j])
+            {
+                jump[r][j] = value;
+                changed_row.push_back(j);
+            }
+        };
+
+        changed_row.clear();
+        if (start <= pos && pos <= start + lr)
+        {
+            // The block itself changed: look for all its occurrences again
+            if (is_wc.empty())
+            {
+                if (Backward)
+                    reversed.assign(text.rbegin(), text.rend());
+                is_wc.resize(n);
+                for (int i = 0; i < n; i++)
+                    is_wc[i] = is_wildcard<Backward>(i);
+            }
+            block_occurrences(Backward ? reversed : text, wildcards, is_wc, d.transitions,
+                              start, lr + 1, options.occurrences, rng, pm_text, occ);
+            for (int j = 0; j < n; j++)
+                set_entry(j, j + lr < n && occ[j]);
+        }
+        else
+        {
+            // Occurrences whose window contains pos, and entries depending
+            // on a changed entry of row r + 1
+            candidates.clear();
+            for (int j = std::max(0, pos - lr); j <= pos; j++)
+                candidates.push_back(j);
+            for (int x : changed)
+                if (x >= lr && (x - lr < pos - lr || x - lr > pos))
+                    candidates.push_back(x - lr);
+            for (int j : candidates)
+                set_entry(j, j + lr < n && block_occurs_at<Backward>(start, lr + 1, j));
+        }
+        std::swap(changed, changed_row);
+    }
+}
+
 int Lcew::lcew(int i, int j) const
 {
+    return lcew_in<false>(i, j);
+}
+
+int Lcew::lcew_backward(int i, int j) const
+{
+    assert(options.backward);
+    int n = text.size();
+    return lcew_in<true>(n - 1 - i, n - 1 - j);
+}
+
+template <bool Backward>
+int Lcew::lcew_in(int i, int j) const
+{
+    LCEW_STATS_ONLY(last_query = QueryStats{.queries = 1});
+    // Adds the counters of this query to the thread total on return.
+    LCEW_STATS_ONLY(struct Flush { ~Flush() { thread_total += last_query; } } flush);
+
     int r = 0;
     int n = text.size();
 
     while (i + r < n && j + r < n)
     {
-        r += next_selected_or_mism(i + r, j + r);
-        if (!matches(i + r, j + r))
+        r += next_selected_or_mism<Backward>(i + r, j + r, min(next_sel<Backward>(i + r), next_sel<Backward>(j + r)));
+        if (!matches<Backward>(i + r, j + r))
             return r;
         else
         {
-            if (is_selected(i + r))
+            LCEW_STATS_ONLY(++last_query.jump_hops);
+            if (is_selected<Backward>(i + r))
             {
-                r += jump[sel_rank[i + r]][j + r] + 1;
+                r += jump_at<Backward>(sel_rank<Backward>(i + r), j + r) + 1;
             }
             else
             {
-                r += jump[sel_rank[j + r]][i + r] + 1;
+                r += jump_at<Backward>(sel_rank<Backward>(j + r), i + r) + 1;
             }
         }
     }
 
     return r;
-}
\ No newline at end of file
+}
+
+int Lcew::diagonal_mismatches(int i, int j, int len, std::span<int> out, int stride) const
+{
+    // Counted as one query, like a call to `lcew`
+    LCEW_STATS_ONLY(last_query = QueryStats{.queries = 1});
+    LCEW_STATS_ONLY(struct Flush { ~Flush() { thread_total += last_query; } } flush);
+
+    int n = text.size();
+    len = std::min(len, n - std::max(i, j));
+    size_t count = 0;
+    // Offsets of the next selected positions on both sides, kept until passed
+    int sel_i = -1, sel_j = -1;
+    int r = 0;
+    while (r < len && count < out.size())
+    {
+        if (sel_i < r)
+            sel_i = r + next_sel(i + r);
+        if (sel_j < r)
+            sel_j = r + next_sel(j + r);
+        r += next_selected_or_mism<false>(i + r, j + r, std::min(sel_i, sel_j) - r);
+        if (r >= len)
+            break;
+
+        if (!matches(i + r, j + r))
+        {
+            out[count++] = r;
+            r = (r / stride + 1) * stride;
+        }
+        else
+        {
+            LCEW_STATS_ONLY(++last_query.jump_hops);
+            if (is_selected(i + r))
+                r += jump_at<false>(sel_rank(i + r), j + r) + 1;
+            else
+                r += jump_at<false>(sel_rank(j + r), i + r) + 1;
+        }
+    }
+
+    return count;
+}
+
+const QueryStats &Lcew::last_query_stats()
+{
+    return last_query;
+}
+
+const QueryStats &Lcew::thread_query_stats()
+{
+    return thread_total;
+}
+
+void Lcew::reset_query_stats()
+{
+    last_query = QueryStats();
+    thread_total = QueryStats();
+}
+
+MemoryUsage Lcew::memory_usage() const
+{
+    MemoryUsage res;
+    res.text = text.capacity() * sizeof(int);
+    // Buckets, plus one node (value and next pointer) per element.
+    res.wildcards = wildcards.bucket_count() * sizeof(void *) + wildcards.size() * (sizeof(int) + sizeof(void *));
+    res.wildcards += wc_list.capacity() * sizeof(int);
+    for (const Direction *d : {&fwd, &bwd})
+    {
+        res.navigation += d->transitions.memory_usage() + d->selected.memory_usage();
+        res.jump += d->jump.capacity() * sizeof(vector<int>);
+        for (auto &row : d->jump)
+            res.jump += row.capacity() * sizeof(int);
+        if (auto &lazy = d->lazy)
+        {
+            std::lock_guard lock(lazy->mtx);
+            res.jump += lazy->selected_pos.capacity() * sizeof(int);
+            res.jump += lazy->rows.capacity() * sizeof(lazy->rows[0]);
+            res.jump += lazy->published.capacity() * sizeof(lazy->published[0]);
+            for (auto &row : lazy->rows)
+                res.jump += row ? row->capacity() * sizeof(int) : 0;
+        }
+    }
+    res.lce = std::visit([](auto &b) { return b.memory_usage(); }, sa);
+    if (reverse_sa)
+        res.lce += reverse_sa->memory_usage();
+    return res;
+}
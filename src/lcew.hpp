@@ -2,15 +2,82 @@
 
 #include "ukkonen.hpp"
 #include "lce.hpp"
+#include "kr_lce.hpp"
+#include "bit_vector.hpp"
+#include "stats.hpp"
+#include <string>
 #include <vector>
+#include <variant>
 #include <unordered_set>
 #include <cassert>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
 
 using std::unordered_set;
 using std::vector;
 
 const char DEFAULT_WILDCARD = '#';
 
+/**
+ * Data structure used by `Lcew` for (usual) LCE queries.
+ */
+enum class LceBackend
+{
+    /** Suffix tree based `Lce`: constant-time queries, many words per symbol. */
+    SuffixTree,
+    /** Karp-Rabin fingerprints `KrLce`: logarithmic-time queries, linear-time construction, few words. */
+    Fingerprint,
+};
+
+/**
+ * Algorithm used to find the occurrences of the blocks between selected
+ * positions, which fill the jump table.
+ */
+enum class OccurrenceMethod
+{
+    /**
+     * Pick the cheapest method for each block, from the text statistics.
+     * May use `Fft`, so the same restriction on symbol 0 applies.
+     */
+    Auto,
+    /**
+     * Pattern matching with wildcards by convolutions (`pm_wc`).
+     *
+     * `pm_wc` replaces the wildcards by 0, so the symbol 0 must not occur
+     * in the text (it would match every symbol). `Scan` has no such limit.
+     */
+    Fft,
+    /** Comparison of the block with every position, skipping its runs of wildcards. */
+    Scan,
+};
+
+/**
+ * Construction options of the LCEW data structure.
+ */
+struct LcewOptions
+{
+    LceBackend backend = LceBackend::SuffixTree;
+    /** With the fingerprint backend, keep one fingerprint every `sample` positions. */
+    int sample = 1;
+    OccurrenceMethod occurrences = OccurrenceMethod::Auto;
+    /**
+     * Compute the entries of the jump table on first use, instead of
+     * computing the whole table during construction.
+     */
+    bool lazy_jump = false;
+    /**
+     * With `lazy_jump`, bound (in bytes) on the memory of the rows of the
+     * jump table, of at least one row: once reached, the oldest rows are
+     * evicted, and their entries computed again if needed. 0 for no limit.
+     */
+    size_t jump_memory_cap = 0;
+    /** Also build the jump table of the backward queries (`lcew_backward`). */
+    bool backward = false;
+};
+
 /**
  * Data structure for efficient longest common extension queries
  * in a text `T` with wildcards (LCEW).
@@ -23,11 +90,71 @@ class Lcew
 private:
     vector<int> text;
     unordered_set<int> wildcards;
-    vector<int> next_tr;
-    vector<int> next_sel;
-    vector<int> sel_rank;
-    vector<vector<int>> jump;
-    Lce sa;
+    // The same symbols, for the vectorized comparisons of `scan_window`
+    vector<int> wc_list;
+    /**
+     * Jump table computed on first use (see `LcewOptions::lazy_jump`).
+     *
+     * Rows are allocated when a first entry is stored in them, and their
+     * entries are computed one by one when a query needs them. Entries are
+     * atomic so that concurrent queries can fill them. Without a memory cap,
+     * rows are never freed and are found without locking through
+     * `published`. With a cap, rows are only read and written under `mtx`,
+     * so that no row outlives its eviction and at most `max_rows` rows exist.
+     */
+    struct LazyJump
+    {
+        using Row = vector<std::atomic<int>>;
+        /** Value of the entries not computed yet. */
+        static constexpr int UNKNOWN = -1;
+
+        vector<int> selected_pos;
+        /** Allocated rows, protected by `mtx`. */
+        vector<std::unique_ptr<Row>> rows;
+        /** `rows[r].get()` once allocated, without a memory cap. */
+        vector<std::atomic<Row *>> published;
+        /** Largest number of allocated rows, 0 for no limit. */
+        size_t max_rows;
+        /** Allocated rows, oldest first. */
+        std::deque<int> allocated;
+        /** Changed whenever the entries are discarded, unique over all tables. */
+        size_t version = 0;
+        std::mutex mtx;
+    };
+
+    /**
+     * Navigation data and jump table of the queries in one direction.
+     *
+     * Positions are counted in the direction of the queries: position `i`
+     * is `T[i]` forward and `T[n - 1 - i]` backward, so that the backward
+     * data is the forward data of the reversed text.
+     */
+    struct Direction
+    {
+        /**
+         * Transitions: the non-wildcard positions preceded by a wildcard,
+         * and the last position.
+         */
+        BitVector transitions;
+        /** Selected positions: every t-th transition, and the last position. */
+        BitVector selected;
+        vector<vector<int>> jump;
+        std::shared_ptr<LazyJump> lazy;
+    };
+    Direction fwd;
+    /** Empty unless built with `LcewOptions::backward`. */
+    Direction bwd;
+    /** Kept to repair the data structure in `update`. */
+    LcewOptions options;
+
+    // Declared before `sa`, which writes into it during construction.
+    BuildStats stats;
+    std::variant<Lce, KrLce> sa;
+    /**
+     * LCE queries in the reversed text, for backward queries with the
+     * suffix tree backend. Fingerprints serve both directions.
+     */
+    std::unique_ptr<Lce> reverse_sa;
 
 public:
     /**
@@ -39,12 +166,13 @@ public:
      * The parameter `t` must be a positive (> 0) integer.
      * 
      * If `wc` is not specified, it defaults to `DEFAULT_WILDCARD` ('#').
+     * `opts` selects, among others, the data structure used for LCE queries.
      */
-    Lcew(vector<int> txt, int t, vector<int> wc = {DEFAULT_WILDCARD});
+    Lcew(vector<int> txt, int t, vector<int> wc = {DEFAULT_WILDCARD}, LcewOptions opts = {});
     /**
      * Build the LCEW data structure (string text).
      */
-    Lcew(string &s, int t, vector<int> wc): Lcew(vector<int>(s.begin(), s.end()), t, wc) {};
+    Lcew(string &s, int t, vector<int> wc, LcewOptions opts = {}): Lcew(vector<int>(s.begin(), s.end()), t, wc, opts) {};
 
     /**
      * Get the value of the LCEW between `T[i..]` and `T[j..]`
@@ -52,17 +180,231 @@ public:
     
     int lcew(int i, int j) const;
 
+    /**
+     * Get the length of the longest common suffix with wildcards of
+     * `T[..i]` and `T[..j]` (both included), i.e. the LCEW going backward.
+     *
+     * The data structure must be built with `LcewOptions::backward`. Both
+     * directions share the text, the wildcards and, with the fingerprint
+     * backend, the LCE data structure.
+     */
+    int lcew_backward(int i, int j) const;
+
+    /**
+     * Mismatches along the diagonal `(i + k, j + k)`, for `0 <= k < len`.
+     *
+     * Writes to `out`, in increasing order, the offsets `k` such that
+     * `T[i + k]` and `T[j + k]` differ and neither is a wildcard, and returns
+     * their number; stops once `out` is full. After a mismatch at `k`, the
+     * search resumes at the next multiple of `stride`, so that a stride of 1
+     * reports all mismatches, and a larger stride at most one per segment of
+     * `stride` offsets. The maximal matching runs are the segments between
+     * two consecutive mismatches.
+     *
+     * Same as calling `lcew` after every mismatch, except that the selected
+     * positions ahead on both sides are kept from one run to the next.
+     */
+    int diagonal_mismatches(int i, int j, int len, std::span<int> out, int stride = 1) const;
+
+    /**
+     * Occurrences of `pattern` in the text, in increasing order.
+     *
+     * Returns all `i` such that `pattern` and `T[i..i + |pattern|)` match,
+     * the symbols of the data structure being wildcards in both.
+     * With the fingerprint backend, each candidate position is verified by
+     * "kangaroo jumps" over the runs of wildcards of the pattern and of the
+     * text, and the runs of symbols in between are compared by fingerprints
+     * in `O(log m)` time, so that the cost per pattern is far below that of
+     * `pm_wc` for patterns with few runs. The suffix tree backend cannot
+     * compare the text with the pattern: `find` then calls `pm_wc`, in
+     * `O(n log n)` time, with the same restriction on the symbol 0.
+     */
+    vector<int> find(const vector<int> &pattern) const;
+
+    /**
+     * Substitute `symbol` for `T[pos]`, which may turn a position into a
+     * wildcard or back.
+     *
+     * Repairs the data structure locally instead of rebuilding it: the
+     * navigation arrays around `pos`, the rows of the jump table whose block
+     * contains `pos`, and in the other rows the entries whose window contains
+     * `pos` or which depend on a changed entry. The selected positions are
+     * kept, so that the query time grows with the number of runs of wildcards
+     * created since the construction.
+     *
+     * The fingerprint backend is updated in `O(n / sample)` time. The suffix
+     * tree backend (the default) cannot be updated: it is rebuilt, with the
+     * one of the reversed text for backward queries, so that every update
+     * costs a full construction of the LCE data structure, `O(n log sigma)`
+     * time. Build with `LceBackend::Fingerprint` when updates are expected.
+     * In lazy mode, the computed entries of the jump table are discarded.
+     *
+     * Must not be called concurrently with queries.
+     */
+    void update(int pos, int symbol);
+
+    /**
+     * Length of the text.
+     */
+    int size() const { return text.size(); };
+
+    /**
+     * Time spent in each phase of the construction.
+     *
+     * Only measured if compiled with `LCEW_STATS`, all zeros otherwise.
+     */
+    const BuildStats &build_stats() const { return stats; };
+
+    /**
+     * Counters of the last call to `lcew` (or `lcew_backward`, or
+     * `diagonal_mismatches`) made by the calling thread.
+     *
+     * Only measured if compiled with `LCEW_STATS`, all zeros otherwise.
+     */
+    static const QueryStats &last_query_stats();
+
+    /**
+     * Counters accumulated over all the queries made by the calling
+     * thread (on any instance) since the last call to `reset_query_stats`.
+     *
+     * Only measured if compiled with `LCEW_STATS`, all zeros otherwise.
+     */
+    static const QueryStats &thread_query_stats();
+    static void reset_query_stats();
+
+    /**
+     * Memory used by each component of the data structure.
+     */
+    MemoryUsage memory_usage() const;
+
 private:
-    inline bool is_selected(int i) const { return next_sel[i] == 0; };
-    inline bool is_wildcard(int i) const { return wildcards.contains(text[i]); };
+    static std::variant<Lce, KrLce> build_lce(vector<int> &txt, const LcewOptions &opts, BuildStats *stats);
+
+    template <bool Backward = false>
+    inline const Direction &dir() const { return Backward ? bwd : fwd; }
+    /** Symbol at position `i` in the direction of the queries. */
+    template <bool Backward = false>
+    inline int at(int i) const { return Backward ? text[text.size() - 1 - i] : text[i]; }
+
+    template <bool Backward = false>
+    inline int lce(int i, int j) const
+    {
+        if (auto *kr = std::get_if<KrLce>(&sa))
+        {
+            if (Backward)
+            {
+                int n = text.size();
+                return kr->lcs(text, n - 1 - i, n - 1 - j);
+            }
+            return kr->lce(text, i, j);
+        }
+        return Backward ? reverse_sa->lce(i, j) : std::get<Lce>(sa).lce(i, j);
+    }
+
+    template <bool Backward = false>
+    inline bool is_selected(int i) const { return dir<Backward>().selected[i]; };
+    /** Distance from `i` to the next transition (at or after `i`). */
+    template <bool Backward = false>
+    inline int next_tr(int i) const { return dir<Backward>().transitions.distance_to_next(i); };
+    /** Distance from `i` to the next selected position (at or after `i`). */
+    template <bool Backward = false>
+    inline int next_sel(int i) const { return dir<Backward>().selected.distance_to_next(i); };
+    /** Rank of the selected position `i` among the selected positions. */
+    template <bool Backward = false>
+    inline int sel_rank(int i) const { return dir<Backward>().selected.rank(i); };
+    template <bool Backward = false>
+    inline bool is_wildcard(int i) const { return wildcards.contains(at<Backward>(i)); };
+    template <bool Backward = false>
     inline bool matches(int i, int j) const
     {
-        return text[i] == text[j] || is_wildcard(i) || is_wildcard(j);
+        return at<Backward>(i) == at<Backward>(j) || is_wildcard<Backward>(i) || is_wildcard<Backward>(j);
+    }
+
+    /**
+     * Number of symbols compared directly by `next_selected_or_mism`
+     * before falling back to an LCE query.
+     */
+    static constexpr int SCAN_WINDOW = 32;
+    /**
+     * Largest number of wildcard symbols for which `scan_window` is vectorized.
+     */
+    static constexpr size_t SIMD_MAX_WILDCARDS = 4;
+
+    /**
+     * Length of the longest common prefix of `T[i..i + w)` and `T[j..j + w)`
+     * that contains no wildcard.
+     */
+    template <bool Backward>
+    int scan_window(int i, int j, int w) const;
+
+    /**
+     * Entry of the jump table for the selected position of rank `r`
+     * and the position `j`.
+     */
+    template <bool Backward>
+    inline int jump_at(int r, int j) const
+    {
+        auto &d = dir<Backward>();
+        return d.lazy ? lazy_jump_at<Backward>(r, j) : d.jump[r][j];
     }
 
+    /**
+     * Same as `jump_at`, in lazy mode: computes the entry, and the entries
+     * of the following rows it depends on, if needed.
+     */
+    template <bool Backward>
+    int lazy_jump_at(int r, int j) const;
+
+    /**
+     * Entry `(r, j)` of the lazy jump table, or `LazyJump::UNKNOWN` if it is
+     * not computed or its row was evicted.
+     */
+    int lazy_entry(LazyJump &lazy, int r, int j) const;
+
+    /**
+     * Store `value` as the entry `(r, j)` of the lazy jump table.
+     *
+     * Allocates the row if needed. When the memory cap is reached, evicts the
+     * oldest row if `evict` is set, and drops the value otherwise.
+     */
+    void store_lazy_entry(LazyJump &lazy, int r, int j, int value, bool evict) const;
+
+    /**
+     * Whether the block `T[start..start + len)` occurs at position `j`,
+     * using LCE queries and skipping runs of wildcards.
+     */
+    template <bool Backward = false>
+    bool block_occurs_at(int start, int len, int j) const;
+
+    /**
+     * Selected positions, in increasing order.
+     */
+    vector<int> selected_positions(const Direction &d) const;
+
+    /**
+     * Compute the navigation data and the jump table of `d` for the text `t`,
+     * given in the direction of `d`.
+     */
+    void build_direction(Direction &d, vector<int> &t, int tr_step);
+
+    /**
+     * Repair the navigation data and the jump table of one direction
+     * after the substitution of `T[pos]`.
+     */
+    template <bool Backward>
+    void repair(int pos);
+
     /**
      * Returns the first selected position or mismatch between
-     * `T[i..]` and `T[j..]`.
+     * `T[i..]` and `T[j..]`, given the distance `m` to the first selected
+     * position of either side.
+     */
+    template <bool Backward>
+    int next_selected_or_mism(int i, int j, int m) const;
+
+    /**
+     * LCEW between positions `i` and `j`, in the direction of the queries.
      */
-    int next_selected_or_mism(int i, int j) const;
+    template <bool Backward>
+    int lcew_in(int i, int j) const;
 };
\ No newline at end of file
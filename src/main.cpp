@@ -3,6 +3,7 @@
 #include <chrono>
 #include <sstream>
 #include <fstream>
+#include <filesystem>
 #include <streambuf>
 #include <iostream>
 #include <stdlib.h>
@@ -10,6 +11,11 @@
 #include "pm_wc.hpp"
 #include "lcew.hpp"
 #include "fast_mm.hpp"
+#include "k_mismatch.hpp"
+#include "k_errors.hpp"
+#include "multi_lcew.hpp"
+#include "async_lcew.hpp"
+#include "cli.hpp"
 
 using namespace std;
 
@@ -75,14 +81,14 @@ vector<int> random_str(size_t len, RNG &rng)
 }
 
 template <class RNG>
-void random_test(size_t nb_str, size_t str_len, size_t it, RNG &rng)
+void random_test(size_t nb_str, size_t str_len, size_t it, RNG &rng, LcewOptions opts = {})
 {
     for (size_t it_s = 0; it_s < nb_str; it_s++)
     {
         vector<int> txt = random_str(str_len, rng);
         std::uniform_int_distribution<> distrib(0, str_len - 1);
         int t = distrib(rng) + 1;
-        Lcew ds(txt, t);
+        Lcew ds(txt, t, {DEFAULT_WILDCARD}, opts);
         for (size_t it_q = 0; it_q < it; it_q++)
         {
             int i = distrib(rng);
@@ -94,6 +100,439 @@ void random_test(size_t nb_str, size_t str_len, size_t it, RNG &rng)
     }
 }
 
+/**
+ * Run `random_test` with each method of finding the block occurrences
+ * forced, since `Auto` picks `Scan` on small random texts.
+ */
+template <class RNG>
+void test_occurrence_methods(size_t nb_str, size_t str_len, size_t it, RNG &rng)
+{
+    for (auto method : {OccurrenceMethod::Fft, OccurrenceMethod::Scan})
+    {
+        LcewOptions opts;
+        opts.occurrences = method;
+        random_test(nb_str, str_len, it, rng, opts);
+    }
+}
+
+/**
+ * Run the command line interface on a text with NUL bytes, which must
+ * not match other symbols even when the construction uses `pm_wc`.
+ */
+template <class RNG>
+void test_cli_nul(size_t it, RNG &rng)
+{
+    auto dir = std::filesystem::temp_directory_path();
+    string text_file = dir / "lcew_test_text", query_file = dir / "lcew_test_queries",
+           answer_file = dir / "lcew_test_answers";
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        int n = 60000;
+        // Long matching blocks, so that the construction picks pm_wc
+        string s(n, 'a');
+        for (auto &c : s)
+            c = rng() % 20 == 0 ? DEFAULT_WILDCARD : c;
+        for (int k = 0; k < 30; k++)
+            s[rng() % n] = 0;
+        // Ends with a symbol, not with a newline dropped by the CLI
+        s.back() = 'a';
+        ofstream(text_file, ios::binary) << s;
+
+        vector<pair<int, int>> queries;
+        ofstream queries_out(query_file);
+        for (int q = 0; q < 2000; q++)
+        {
+            queries.emplace_back(rng() % n, rng() % n);
+            queries_out << queries.back().first << " " << queries.back().second << "\n";
+        }
+        queries_out.close();
+
+        string args[] = {"main", "lcew", text_file, "-t", "64", "-q", query_file, "-o", answer_file};
+        char *argv[std::size(args)];
+        for (size_t k = 0; k < std::size(args); k++)
+            argv[k] = args[k].data();
+        assert(run_cli(std::size(args), argv) == 0);
+
+        vector<int> txt((unsigned char *)s.data(), (unsigned char *)s.data() + n);
+        ifstream answers(answer_file);
+        for (auto [i, j] : queries)
+        {
+            int a;
+            answers >> a;
+            assert(a == naive_lcew_sharp(txt, i, j));
+        }
+    }
+    std::filesystem::remove(text_file);
+    std::filesystem::remove(query_file);
+    std::filesystem::remove(answer_file);
+}
+
+/**
+ * Check `Lcew::diagonal_mismatches` against a scan of the diagonal,
+ * with random lengths, strides and buffer sizes.
+ */
+template <class RNG>
+void test_diagonal_mismatches(size_t it, RNG &rng)
+{
+    auto matches = [](int a, int b)
+    {
+        return a == b || a == DEFAULT_WILDCARD || b == DEFAULT_WILDCARD;
+    };
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(1 + rng() % 300, rng);
+        for (auto &c : txt)
+            c = c == DEFAULT_WILDCARD ? c : 'a' + c % 2;
+        int n = txt.size();
+        Lcew ds(txt, 1 + rng() % 10);
+        for (int q = 0; q < 50; q++)
+        {
+            int i = rng() % n, j = rng() % n, len = rng() % (n + 1);
+            int stride = 1 + rng() % 8;
+            vector<int> out(rng() % 10);
+
+            vector<int> expected;
+            for (int k = 0; k < len && i + k < n && j + k < n && expected.size() < out.size(); k++)
+            {
+                if (!matches(txt[i + k], txt[j + k]))
+                {
+                    expected.push_back(k);
+                    k = (k / stride + 1) * stride - 1;
+                }
+            }
+            int count = ds.diagonal_mismatches(i, j, len, out, stride);
+            out.resize(count);
+            assert(out == expected);
+        }
+    }
+}
+
+/**
+ * Check `Lcew::find` against a scan, with both LCE backends,
+ * on small alphabets so that patterns occur often.
+ */
+template <class RNG>
+void test_lcew_find(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        auto random_text = [&](int len)
+        {
+            vector<int> res(len);
+            for (auto &c : res)
+                c = rng() % 4 == 0 ? DEFAULT_WILDCARD : 'a' + rng() % 2;
+            return res;
+        };
+        vector<int> txt = random_text(1 + rng() % 300);
+        LcewOptions opts;
+        opts.backend = rng() % 2 ? LceBackend::Fingerprint : LceBackend::SuffixTree;
+        opts.sample = 1 + rng() % 4;
+        Lcew ds(txt, 1 + rng() % 10, {DEFAULT_WILDCARD}, opts);
+        for (int q = 0; q < 20; q++)
+        {
+            vector<int> pat = random_text(1 + rng() % 12);
+            // Not pm_wc, which `find` uses with the suffix tree backend
+            vector<int> expected;
+            for (size_t i = 0; i + pat.size() <= txt.size(); i++)
+            {
+                size_t k = 0;
+                while (k < pat.size() && (pat[k] == txt[i + k] || pat[k] == DEFAULT_WILDCARD || txt[i + k] == DEFAULT_WILDCARD))
+                    k++;
+                if (k == pat.size())
+                    expected.push_back(i);
+            }
+            assert(ds.find(pat) == expected);
+        }
+    }
+}
+
+/**
+ * Check rank, select and `distance_to_next` of `BitVector` against a scan,
+ * before and after setting random bits.
+ */
+template <class RNG>
+void test_bit_vector(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        // Every fourth vector alternates very sparse and dense ranges, so
+        // that `select` uses both the inventory and the search of blocks
+        bool mixed = it_s % 4 == 3;
+        size_t n = 1 + rng() % (mixed ? 400000 : 5000);
+        // Sparse or dense, with the last bit set for distance_to_next
+        unsigned density = 1 + rng() % 100;
+        vector<bool> bits(n);
+        for (size_t i = 0; i < n; i++)
+            bits[i] = mixed && i / 100000 % 2 == 0 ? rng() % 20000 == 0 : rng() % 100 < density;
+        bits[n - 1] = true;
+        BitVector bv(bits);
+        for (int round = 0; round < 2; round++)
+        {
+            size_t ones = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                assert(bv[i] == bits[i] && bv.rank(i) == ones);
+                if (bits[i])
+                    assert(bv.select(ones++) == i);
+            }
+            assert(bv.ones() == ones && bv.rank(n) == ones);
+            for (size_t i = n; i-- > 0;)
+            {
+                int next = bits[i] ? 0 : bv.distance_to_next(i + 1) + 1;
+                assert(bv.distance_to_next(i) == next);
+            }
+
+            for (int u = 0; u < 50; u++)
+            {
+                size_t i = rng() % (n - 1 + (n == 1));
+                bits[i] = n == 1 || rng() % 2;
+                bv.set(i, bits[i]);
+            }
+        }
+    }
+}
+
+/**
+ * Check that `Lcew::update` keeps the data structure correct, for every
+ * LCE backend and with a lazy jump table, on texts updated at random
+ * positions (often turning them into wildcards or back).
+ */
+template <class RNG>
+void test_lcew_update(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(1 + rng() % 300, rng);
+        int n = txt.size();
+        LcewOptions opts;
+        opts.backend = rng() % 2 ? LceBackend::Fingerprint : LceBackend::SuffixTree;
+        opts.sample = 1 + rng() % 4;
+        opts.lazy_jump = rng() % 4 == 0;
+        opts.backward = rng() % 2;
+        Lcew ds(txt, 1 + rng() % 10, {DEFAULT_WILDCARD}, opts);
+        for (int u = 0; u < 20; u++)
+        {
+            int pos = rng() % n;
+            txt[pos] = rng() % 3 == 0 ? DEFAULT_WILDCARD : 'a' + rng() % 3;
+            ds.update(pos, txt[pos]);
+            vector<int> rev(txt.rbegin(), txt.rend());
+            for (int q = 0; q < 200; q++)
+            {
+                int i = rng() % n, j = rng() % n;
+                assert(ds.lcew(i, j) == naive_lcew_sharp(txt, i, j));
+                if (opts.backward)
+                    assert(ds.lcew_backward(i, j) == naive_lcew_sharp(rev, n - 1 - i, n - 1 - j));
+            }
+        }
+    }
+}
+
+/**
+ * Check a lazy jump table with a memory cap of a few rows: queries stay
+ * correct, and the rows allocated never exceed the cap. Also runs the
+ * queries of alternating wildcards, whose entries depend on long chains
+ * of rows.
+ */
+template <class RNG>
+void test_lazy_jump_cap(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s <= it; it_s++)
+    {
+        vector<int> txt;
+        if (it_s < it)
+        {
+            txt = random_str(1 + rng() % 300, rng);
+            for (auto &c : txt)
+                c = c == DEFAULT_WILDCARD ? c : 'a' + c % 2;
+        }
+        else
+        {
+            for (int k = 0; k < 2000; k++)
+                txt.insert(txt.end(), {DEFAULT_WILDCARD, 'a'});
+        }
+        int n = txt.size();
+        LcewOptions opts;
+        opts.lazy_jump = true;
+        opts.backward = rng() % 2;
+        opts.jump_memory_cap = (1 + rng() % 4) * n * sizeof(int);
+        Lcew ds(txt, it_s < it ? 1 + rng() % 5 : 1, {DEFAULT_WILDCARD}, opts);
+        // Memory of the table without any row
+        size_t base = ds.memory_usage().jump;
+        vector<int> rev(txt.rbegin(), txt.rend());
+        for (int q = 0; q < 500; q++)
+        {
+            int i = rng() % n, j = rng() % n;
+            if (it_s == it)
+                i = 2 * (q % 50), j = i + 2;
+            assert(ds.lcew(i, j) == naive_lcew_sharp(txt, i, j));
+            if (opts.backward)
+                assert(ds.lcew_backward(i, j) == naive_lcew_sharp(rev, n - 1 - i, n - 1 - j));
+            assert(ds.memory_usage().jump <= base + (opts.backward ? 2 : 1) * opts.jump_memory_cap);
+        }
+    }
+}
+
+/**
+ * Check backward queries against forward queries in the reversed text,
+ * with both LCE backends and with a lazy jump table.
+ */
+template <class RNG>
+void test_lcew_backward(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(1 + rng() % 300, rng);
+        for (auto &c : txt)
+            c = c == DEFAULT_WILDCARD ? c : 'a' + c % 3;
+        int n = txt.size();
+        vector<int> rev(txt.rbegin(), txt.rend());
+        LcewOptions opts;
+        opts.backend = rng() % 2 ? LceBackend::Fingerprint : LceBackend::SuffixTree;
+        opts.sample = 1 + rng() % 4;
+        opts.lazy_jump = rng() % 3 == 0;
+        opts.backward = true;
+        Lcew ds(txt, 1 + rng() % 10, {DEFAULT_WILDCARD}, opts);
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                assert(ds.lcew(i, j) == naive_lcew_sharp(txt, i, j));
+                assert(ds.lcew_backward(i, j) == naive_lcew_sharp(rev, n - 1 - i, n - 1 - j));
+            }
+        }
+    }
+}
+
+/**
+ * Check that `AsyncLcew` gives the right answers before and after
+ * the index is ready.
+ */
+template <class RNG>
+void test_async_lcew(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(1 + rng() % 2000, rng);
+        int n = txt.size();
+        std::atomic<bool> called = false;
+        AsyncLcew ds(txt, 1 + rng() % 20, {DEFAULT_WILDCARD}, {}, [&](const Lcew &)
+                     { called = true; });
+        for (int wait = 0; wait < 2; wait++)
+        {
+            for (int q = 0; q < 1000; q++)
+            {
+                int i = rng() % n, j = rng() % n;
+                assert(ds.lcew(i, j) == naive_lcew_sharp(txt, i, j));
+            }
+            ds.future().wait();
+        }
+        assert(ds.is_ready() && called && ds.index().size() == n);
+    }
+}
+
+/**
+ * Check that `MultiLcew` is correct on random collections of documents.
+ */
+template <class RNG>
+void test_multi_lcew(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<vector<int>> docs(1 + rng() % 5);
+        for (auto &d : docs)
+            d = random_str(rng() % 30, rng);
+        MultiLcew ds(docs, 1 + rng() % 10);
+
+        for (size_t a = 0; a < docs.size(); a++)
+            for (size_t b = 0; b < docs.size(); b++)
+                for (size_t i = 0; i <= docs[a].size(); i++)
+                    for (size_t j = 0; j <= docs[b].size(); j++)
+                    {
+                        int len_a = docs[a].size() - i, len_b = docs[b].size() - j;
+                        vector<int> s(docs[a].begin() + i, docs[a].end());
+                        s.insert(s.end(), docs[b].begin() + j, docs[b].end());
+                        int expected = min({naive_lcew_sharp(s, 0, len_a), len_a, len_b});
+                        assert(ds.lcew(a, i, b, j) == expected);
+                    }
+    }
+}
+
+/**
+ * Check `k_mismatch` against a quadratic scan on random strings.
+ */
+template <class RNG>
+void test_k_mismatch(size_t it, RNG &rng)
+{
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(200, rng);
+        vector<int> pat = random_str(1 + rng() % 20, rng);
+        int k = rng() % 4;
+
+        vector<MismatchOccurrence> expected;
+        for (size_t i = 0; i + pat.size() <= txt.size(); i++)
+        {
+            MismatchOccurrence occ{(int)i, 0, {}};
+            for (size_t j = 0; j < pat.size(); j++)
+            {
+                int a = txt[i + j], b = pat[j];
+                if (a != b && a != DEFAULT_WILDCARD && b != DEFAULT_WILDCARD)
+                {
+                    occ.mismatches++;
+                    occ.mism_pos.push_back(j);
+                }
+            }
+            if (occ.mismatches <= k)
+                expected.push_back(occ);
+        }
+
+        auto res = k_mismatch(pat, txt, k, 1 + rng() % 10, {DEFAULT_WILDCARD}, true);
+        assert(res == expected);
+    }
+}
+
+/**
+ * Check `k_errors` against the dynamic programming algorithm on random strings.
+ */
+template <class RNG>
+void test_k_errors(size_t it, RNG &rng)
+{
+    auto matches = [&](int a, int b) -> bool
+    {
+        return a == b || a == DEFAULT_WILDCARD || b == DEFAULT_WILDCARD;
+    };
+
+    for (size_t it_s = 0; it_s < it; it_s++)
+    {
+        vector<int> txt = random_str(100, rng);
+        vector<int> pat = random_str(1 + rng() % 15, rng);
+        int k = rng() % 5;
+        int n = txt.size(), m = pat.size();
+
+        // dp[i][j]: edit distance between pat[..i) and a suffix of txt[..j)
+        vector<vector<int>> dp(m + 1, vector<int>(n + 1, 0));
+        for (int i = 1; i <= m; i++)
+        {
+            dp[i][0] = i;
+            for (int j = 1; j <= n; j++)
+            {
+                dp[i][j] = min({dp[i - 1][j] + 1, dp[i][j - 1] + 1,
+                                dp[i - 1][j - 1] + !matches(pat[i - 1], txt[j - 1])});
+            }
+        }
+
+        vector<ErrorOccurrence> expected;
+        for (int j = 1; j <= n; j++)
+        {
+            if (dp[m][j] <= k)
+                expected.push_back({j - 1, dp[m][j]});
+        }
+
+        auto res = k_errors(pat, txt, k, 1 + rng() % 10);
+        assert(res == expected);
+    }
+}
+
 void simple_mm()
 {
     vector<vector<bool>> id_dense = {{true, false}, {false, true}};
@@ -153,6 +592,38 @@ double test_mm(size_t n, double p, RNG &rng)
     return time_rep;
 }
 
+template <class RNG>
+void test_closure(size_t it, RNG &rng)
+{
+    for (size_t k = 0; k < it; k++)
+    {
+        int n = 1 + rng() % 12;
+        auto a = random_bool_mat(n, 1.5 / n, rng);
+        SparseBoolMatrix a_s = SparseBoolMatrix::from_dense(a);
+
+        // Powers and closure by repeated dense multiplication
+        auto pow = a;
+        auto closure = a;
+        unsigned e = 1 + rng() % 20;
+        for (int l = 2; l <= std::max(n, (int)e); l++)
+        {
+            pow = mat_mul(pow, a);
+            if ((unsigned)l == e)
+                assert(SparseBoolMatrix::from_dense(pow) == a_s.power(e));
+            for (int i = 0; i < n && l <= n; i++)
+                for (int j = 0; j < n; j++)
+                    closure[i][j] = closure[i][j] || pow[i][j];
+        }
+        if (e == 1)
+            assert(a_s.power(e) == a_s);
+
+        assert(a_s.transitive_closure() == SparseBoolMatrix::from_dense(closure));
+        for (int i = 0; i < n; i++)
+            closure[i][i] = true;
+        assert(a_s.transitive_closure(true) == SparseBoolMatrix::from_dense(closure));
+    }
+}
+
 size_t nb_rep(2);
 
 /**
@@ -190,8 +661,11 @@ void run_tests(size_t max_size, size_t step)
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    if (argc > 1)
+        return run_cli(argc, argv);
+
     // random_device rd;
     // mt19937 rng(rd());
     // test_pm_wc_jump(100, rng);
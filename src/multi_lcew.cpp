@@ -0,0 +1,55 @@
+#include "multi_lcew.hpp"
+
+namespace
+{
+    vector<int> doc_offsets(const vector<vector<int>> &docs)
+    {
+        vector<int> res = {0};
+        for (auto &d : docs)
+            res.push_back(res.back() + d.size() + 1);
+        return res;
+    }
+
+    /**
+     * Concatenate the documents, each followed by a symbol that
+     * does not appear in any of them and is not a wildcard.
+     *
+     * The separator is not needed for correctness (extensions are capped
+     * at the end of documents) but stops most of them at the boundary.
+     */
+    vector<int> concatenate(const vector<vector<int>> &docs, const vector<int> &wc)
+    {
+        int sep = 0;
+        for (int c : wc)
+            sep = max(sep, c + 1);
+        for (auto &d : docs)
+            for (int c : d)
+                sep = max(sep, c + 1);
+
+        vector<int> res;
+        for (auto &d : docs)
+        {
+            res.insert(res.end(), d.begin(), d.end());
+            res.push_back(sep);
+        }
+        return res;
+    }
+}
+
+MultiLcew::MultiLcew(const vector<vector<int>> &docs, int t, vector<int> wc, LcewOptions opts)
+    : offsets(doc_offsets(docs)), ds(concatenate(docs, wc), t, wc, opts)
+{
+}
+
+int MultiLcew::lcew(int doc_a, int i, int doc_b, int j) const
+{
+    assert(0 <= doc_a && doc_a < doc_count() && 0 <= doc_b && doc_b < doc_count());
+    int len_a = doc_size(doc_a) - i;
+    int len_b = doc_size(doc_b) - j;
+    assert(len_a >= 0 && len_b >= 0);
+
+    if (len_a == 0 || len_b == 0)
+        return 0;
+
+    return min({ds.lcew(offsets[doc_a] + i, offsets[doc_b] + j), len_a, len_b});
+}
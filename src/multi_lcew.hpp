@@ -0,0 +1,50 @@
+#pragma once
+
+#include "lcew.hpp"
+#include <vector>
+
+using std::vector;
+
+/**
+ * Data structure for LCEW queries between suffixes of documents
+ * of a collection, with wildcards.
+ *
+ * The documents are indexed together in a single `Lcew`
+ * and extensions never cross the end of a document.
+ */
+class MultiLcew
+{
+private:
+    /** Starting position of each document in the index, plus the total length. */
+    vector<int> offsets;
+    Lcew ds;
+
+public:
+    /**
+     * Build the data structure for the documents `docs`, with query time `O(t)`
+     * and using symbols in `wc` as wildcards.
+     * See `Lcew` for `opts`.
+     */
+    MultiLcew(const vector<vector<int>> &docs, int t, vector<int> wc = {DEFAULT_WILDCARD}, LcewOptions opts = {});
+
+    /**
+     * Get the value of the LCEW between `D_a[i..]` and `D_b[j..]`,
+     * where `D_a` and `D_b` are the documents of index `doc_a` and `doc_b`.
+     *
+     * `i` (resp. `j`) may be equal to the length of `D_a` (resp. `D_b`).
+     */
+    int lcew(int doc_a, int i, int doc_b, int j) const;
+
+    int doc_count() const { return offsets.size() - 1; };
+    int doc_size(int doc) const { return offsets[doc + 1] - offsets[doc] - 1; };
+
+    /**
+     * Position of the first symbol of document `doc` in the underlying index.
+     */
+    int offset(int doc) const { return offsets[doc]; };
+
+    /**
+     * The underlying index, over all documents each followed by a separator.
+     */
+    const Lcew &index() const { return ds; };
+};
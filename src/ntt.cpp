@@ -1,12 +1,33 @@
 #include "ntt.hpp"
+#include <atomic>
+#include <barrier>
 #include <bit>
+#include <cassert>
+#include <memory>
+#include <thread>
 
 typedef unsigned long long ULL;
 
-const unsigned P = 2013265921;   // 15*2^27+1
+const unsigned P = NTT_MOD;
 const unsigned ROOT = 440564289; // root
-const int MN = 25;               // must be < 27
-unsigned omega[1 << MN];
+// Transforms from 2^FOUR_STEP_LOG entries are split into sub-transforms of
+// about the square root of their size, which fit in cache
+const int FOUR_STEP_LOG = 16;
+// Transforms from 2^PARALLEL_LOG entries share their rows between threads
+const int PARALLEL_LOG = 18;
+// Transforms up to 2^KEEP_BUFFER_LOG entries keep their transpose buffer for
+// the next transform of the thread, larger ones free it on return
+const int KEEP_BUFFER_LOG = 20;
+// Side of the tiles of the blocked transpose
+const int TILE = 32;
+// Powers of the roots of unity, per thread so that transforms can run concurrently
+thread_local vector<unsigned> omega, omega_rows;
+// Buffer of the transposes
+thread_local vector<unsigned> transposed;
+// Maximal number of threads of the transforms (0: one per hardware thread)
+std::atomic<unsigned> max_threads = 0;
+// Helper threads currently started by transforms, over all calling threads
+std::atomic<unsigned> busy_helpers = 0;
 
 unsigned pw(unsigned x, unsigned n)
 {
@@ -22,40 +43,217 @@ unsigned pw(unsigned x, unsigned n)
     return res;
 }
 
-void fft(vector<unsigned> &a, int n, bool inverse = false)
+void set_ntt_threads(unsigned threads)
 {
-    //(direct/inverse) FFT transform of A
-    int N = 1 << n;
-    a.insert(a.end(), N - a.size(), 0); // vector of size 2^n
-    unsigned root = pw(ROOT, (1 << 27) / N * (inverse ? (N - 1) : 1));
-    omega[0] = 1;
-    for (int i = 1; i < N - 1; ++i)
-        omega[i] = (ULL)omega[i - 1] * root % P;
-    for (int i = 0; i < n; ++i)
+    max_threads = threads;
+}
+
+namespace
+{
+    /**
+     * Fill `w` with the first `len` powers of `root` (at least one).
+     */
+    void fill_powers(vector<unsigned> &w, unsigned root, size_t len)
+    {
+        if (w.size() < len)
+            w.resize(len);
+        w[0] = 1;
+        for (size_t i = 1; i < len; ++i)
+            w[i] = (ULL)w[i - 1] * root % P;
+    }
+
+    /**
+     * Radix-2 transform of the 2^n entries at `a`,
+     * with `w[k]` the k-th power of a primitive 2^n-th root of unity.
+     */
+    void radix2(unsigned *a, int n, const unsigned *w)
     {
-        for (int j = 0; j < (1 << i); ++j)
+        int N = 1 << n;
+        for (int i = 0; i < n; ++i)
         {
-            for (int k = 0; k < (1 << (n - i - 1)); ++k)
+            int half = 1 << (n - i - 1);
+            for (int s = 0; s < N; s += 2 * half)
             {
-                int s = (j << (n - i)) + k;
-                int t = s + (1 << (n - i - 1));
-                unsigned w = omega[k << i];
-                unsigned temp = a[s] + a[t];
-                if (temp >= P)
-                    temp -= P;
-                unsigned t2 = a[s] - a[t] + P;
-                a[t] = (ULL)w * t2 % P;
-                a[s] = temp;
+                for (int k = 0; k < half; ++k)
+                {
+                    unsigned x = a[s + k], y = a[s + k + half];
+                    unsigned temp = x + y;
+                    if (temp >= P)
+                        temp -= P;
+                    a[s + k + half] = (ULL)w[k << i] * (x - y + P) % P;
+                    a[s + k] = temp;
+                }
             }
         }
+        // bit-reversal permutation, with j the reversal of i
+        for (int i = 1, j = 0; i < N; ++i)
+        {
+            int bit = N >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                swap(a[i], a[j]);
+        }
     }
-    for (int i = 0; i < N; ++i)
+
+    /**
+     * Helper threads that a transform may start, reserved until destruction.
+     *
+     * The calling threads of the transforms are not counted, so that
+     * concurrent transforms use at most `max_threads` threads in total
+     * besides their callers, and none when the callers already fill it.
+     */
+    class HelperReservation
     {
-        int x = i, y = 0;
-        for (int j = 0; j < n; ++j)
-            y = (y << 1) + (x & 1), x >>= 1;
-        if (i < y)
-            swap(a[i], a[y]);
+    private:
+        unsigned count = 0;
+
+    public:
+        explicit HelperReservation(unsigned wanted)
+        {
+            unsigned limit = max_threads.load();
+            if (limit == 0)
+                limit = std::max(1u, std::thread::hardware_concurrency());
+            unsigned busy = busy_helpers.load();
+            do
+                count = std::min(wanted, limit - 1 > busy ? limit - 1 - busy : 0);
+            while (count > 0 && !busy_helpers.compare_exchange_weak(busy, busy + count));
+        }
+        ~HelperReservation() { busy_helpers -= count; }
+        HelperReservation(const HelperReservation &) = delete;
+        HelperReservation &operator=(const HelperReservation &) = delete;
+
+        unsigned size() const { return count; }
+    };
+
+    /**
+     * Part `part` of a partition of [0, count) into `parts` contiguous ranges.
+     */
+    std::pair<int, int> share(int count, unsigned part, unsigned parts)
+    {
+        return {(int)((ULL)count * part / parts), (int)((ULL)count * (part + 1) / parts)};
+    }
+
+    /**
+     * Part `part` out of `parts` of the blocked transpose of the rows x cols
+     * matrix `src` into `dst`.
+     */
+    void transpose(const unsigned *src, unsigned *dst, int rows, int cols, unsigned part, unsigned parts)
+    {
+        auto [begin, end] = share((rows + TILE - 1) / TILE, part, parts);
+        for (int bi = begin * TILE; bi < std::min(rows, end * TILE); bi += TILE)
+            for (int bj = 0; bj < cols; bj += TILE)
+                for (int i = bi; i < std::min(rows, bi + TILE); ++i)
+                    for (int j = bj; j < std::min(cols, bj + TILE); ++j)
+                        dst[(size_t)j * rows + i] = src[(size_t)i * cols + j];
+    }
+
+    /**
+     * Four-step transform of the 2^n entries at `a`, with `root` a primitive
+     * 2^n-th root of unity.
+     *
+     * With N = N1 * N2 and `a` seen as an N1 x N2 matrix, the N2 columns are
+     * transformed, multiplied by the twiddle factors root^(j2 * k1),
+     * then the N1 rows are transformed and the result is read column-wise.
+     * Columns are transposed into rows so that every sub-transform is
+     * contiguous.
+     *
+     * Large transforms start their helper threads once, and every thread
+     * does its share of each step, waiting for the others between steps.
+     */
+    void four_step(unsigned *a, int n, unsigned root)
+    {
+        int n1 = (n + 1) / 2, n2 = n / 2;
+        int N1 = 1 << n1, N2 = 1 << n2;
+        size_t N = (size_t)1 << n;
+        std::unique_ptr<unsigned[]> large_buffer;
+        unsigned *b;
+        if (n <= KEEP_BUFFER_LOG)
+        {
+            if (transposed.size() < N)
+                transposed.resize(N);
+            b = transposed.data();
+        }
+        else
+        {
+            large_buffer = std::make_unique_for_overwrite<unsigned[]>(N);
+            b = large_buffer.get();
+        }
+        // roots of unity of the columns (of size N1) then the rows (of size N2)
+        fill_powers(omega, pw(root, N2), N1 / 2);
+        fill_powers(omega_rows, pw(root, N1), N2 / 2);
+        const unsigned *w1 = omega.data(), *w2 = omega_rows.data();
+
+        HelperReservation helpers(n >= PARALLEL_LOG ? N2 : 0);
+        unsigned parts = helpers.size() + 1;
+        std::barrier sync(parts);
+        auto run = [&](unsigned part)
+        {
+            transpose(a, b, N1, N2, part, parts);
+            sync.arrive_and_wait();
+            auto [col_begin, col_end] = share(N2, part, parts);
+            unsigned step = pw(root, col_begin);
+            for (int j2 = col_begin; j2 < col_end; ++j2)
+            {
+                unsigned *row = b + (size_t)j2 * N1;
+                radix2(row, n1, w1);
+                unsigned w = 1;
+                for (int k1 = 0; k1 < N1; ++k1)
+                {
+                    row[k1] = (ULL)row[k1] * w % P;
+                    w = (ULL)w * step % P;
+                }
+                step = (ULL)step * root % P;
+            }
+            sync.arrive_and_wait();
+            transpose(b, a, N2, N1, part, parts);
+            sync.arrive_and_wait();
+            auto [row_begin, row_end] = share(N1, part, parts);
+            for (int k1 = row_begin; k1 < row_end; ++k1)
+                radix2(a + (size_t)k1 * N2, n2, w2);
+            sync.arrive_and_wait();
+            transpose(a, b, N1, N2, part, parts);
+            sync.arrive_and_wait();
+            std::copy(b + (size_t)col_begin * N1, b + (size_t)col_end * N1, a + (size_t)col_begin * N1);
+        };
+
+        vector<std::thread> workers;
+        workers.reserve(parts - 1);
+        try
+        {
+            for (unsigned part = 1; part < parts; ++part)
+                workers.emplace_back(run, part);
+        }
+        catch (...)
+        {
+            // Let the threads already started go through their steps
+            // without the missing parts, then report the failure
+            for (size_t part = workers.size(); part < parts; ++part)
+                sync.arrive_and_drop();
+            for (auto &w : workers)
+                w.join();
+            throw;
+        }
+        run(0);
+        for (auto &w : workers)
+            w.join();
+    }
+}
+
+void fft(std::span<unsigned> a, int n, bool inverse)
+{
+    //(direct/inverse) FFT transform of A
+    assert(n <= 27);
+    int N = 1 << n;
+    assert(a.size() == (size_t)N);
+    unsigned root = pw(ROOT, (1 << 27) / N * (inverse ? (N - 1) : 1));
+    if (n >= FOUR_STEP_LOG)
+        four_step(a.data(), n, root);
+    else
+    {
+        fill_powers(omega, root, std::max(1, N / 2));
+        radix2(a.data(), n, omega.data());
     }
     if (inverse)
     {
@@ -65,14 +263,74 @@ void fft(vector<unsigned> &a, int n, bool inverse = false)
     }
 }
 
-vector<unsigned> conv(vector<unsigned> A, vector<unsigned> B)
+void fft(vector<unsigned> &a, int n, bool inverse)
+{
+    a.resize(1 << n, 0); // vector of size 2^n
+    fft(std::span<unsigned>(a), n, inverse);
+}
+
+void conv_inplace(vector<unsigned> &A, vector<unsigned> &B)
 {
-    // compute the convolution of A and B
-    int n = 31 - __builtin_clz(2 * (A.size() + B.size()) - 1);
+    if (A.empty() || B.empty())
+    {
+        A.clear();
+        return;
+    }
+
+    // compute the convolution of A and B,
+    // with a transform just large enough to avoid wrapping around
+    size_t len = A.size() + B.size() - 1;
+    int n = bit_width(len - 1);
     fft(A, n);
     fft(B, n);
     for (int i = 0; i < (1 << n); ++i)
         A[i] = (ULL)A[i] * B[i] % P;
     fft(A, n, true);
+    A.resize(len);
+}
+
+vector<unsigned> conv(vector<unsigned> A, vector<unsigned> B)
+{
+    conv_inplace(A, B);
     return A;
-}
\ No newline at end of file
+}
+
+void test_ntt(std::mt19937 &rng)
+{
+    auto check = [](int n, std::mt19937 &rng)
+    {
+        int N = 1 << n;
+        std::uniform_int_distribution<unsigned> distrib(0, P - 1);
+        vector<unsigned> a(N);
+        for (auto &x : a)
+            x = distrib(rng);
+        vector<unsigned> expected = a, w;
+        fill_powers(w, pw(ROOT, (1 << 27) / N), N / 2);
+        radix2(expected.data(), n, w.data());
+        vector<unsigned> res = a;
+        fft(res, n);
+        assert(res == expected);
+        fft(res, n, true);
+        assert(res == a);
+    };
+
+    // Sizes with and without helper threads, and above the kept buffers
+    for (unsigned threads : {1, 2, 4})
+    {
+        set_ntt_threads(threads);
+        for (int n : {FOUR_STEP_LOG, PARALLEL_LOG, PARALLEL_LOG + 1, KEEP_BUFFER_LOG + 1})
+            check(n, rng);
+    }
+
+    // Concurrent callers sharing the helper threads
+    set_ntt_threads(4);
+    vector<std::thread> callers;
+    for (int c = 0; c < 3; c++)
+        callers.emplace_back([&check, seed = rng()]
+                             {
+            std::mt19937 local(seed);
+            check(PARALLEL_LOG, local); });
+    for (auto &c : callers)
+        c.join();
+    set_ntt_threads(0);
+}
@@ -6,14 +6,76 @@
 #pragma once
 
 #include <algorithm>
+#include <random>
+#include <span>
 #include <vector>
 
 using namespace std;
 
+/**
+ * \brief The prime modulo which convolutions are computed.
+ */
+const unsigned NTT_MOD = 2013265921; // 15*2^27+1
+
+/**
+ * \brief In-place transform of size 2^n.
+ * \param a the vector to transform, of size at most 2^n, padded with zeros to 2^n
+ * \param n the logarithm of the size of the transform
+ * \param inverse whether to apply the inverse transform (including the division by 2^n)
+ *
+ * Transforms are in natural order, so that a convolution is
+ * fft(A), fft(B), pointwise product modulo NTT_MOD, inverse fft.
+ * Sums of pointwise products can be accumulated before a single inverse fft.
+ */
+void fft(vector<unsigned> &a, int n, bool inverse = false);
+
+/**
+ * \brief In-place transform of size 2^n of a span of size exactly 2^n.
+ *
+ * Up to 2^20 entries, does not allocate, except to grow the buffers of the
+ * calling thread on its first transform of a given size; larger transforms
+ * allocate a buffer of their size, freed on return.
+ * Large transforms use a four-step decomposition into sub-transforms
+ * that fit in cache, and share them between threads (see set_ntt_threads).
+ */
+void fft(std::span<unsigned> a, int n, bool inverse = false);
+
+/**
+ * \brief Maximal number of threads used by large transforms.
+ * \param threads the number of threads, or 0 (the default) for one per hardware thread
+ *
+ * Each transform runs on its calling thread and starts helper threads;
+ * concurrent transforms share `threads - 1` helpers between them, so that
+ * callers already running on all cores get few or none.
+ * Set it to 1 to run every transform on its calling thread only.
+ */
+void set_ntt_threads(unsigned threads);
+
 /**
  * \brief Computing the convolution of two integer vectors.
  * \param A the first vector
  * \param B the second vector
- * \return the convolution of A and B
+ * \return the convolution of A and B, of size |A| + |B| - 1
+ *
+ * Entries of A and B must be smaller than NTT_MOD,
+ * and the result is computed modulo NTT_MOD.
  */ 
-vector<unsigned> conv(vector<unsigned> A, vector<unsigned> B);
\ No newline at end of file
+vector<unsigned> conv(vector<unsigned> A, vector<unsigned> B);
+
+/**
+ * \brief Computing the convolution of two integer vectors in place.
+ * \param A the first vector, replaced by the convolution of A and B
+ *          (of size |A| + |B| - 1)
+ * \param B the second vector, overwritten
+ *
+ * Does not allocate if A and B already have enough capacity,
+ * so that buffers can be reused across calls.
+ */
+void conv_inplace(vector<unsigned> &A, vector<unsigned> &B);
+
+/**
+ * \brief Check the transforms large enough for the four-step decomposition
+ * and its threads against the radix-2 transform, with one and several threads,
+ * and from concurrent callers.
+ */
+void test_ntt(std::mt19937 &rng);
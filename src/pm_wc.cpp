@@ -1,7 +1,10 @@
 #include "pm_wc.hpp"
-#include "ntt.hpp"
-#include <iostream>
+#include "conv.hpp"
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <iostream>
 
 template <class T, class F>
 vector<unsigned> vec_map(const vector<T> &v, F &&f)
@@ -26,43 +29,418 @@ ostream &operator<<(ostream &os, const vector<T> &v)
     return os;
 }
 
-vector<bool> pm_wc(const vector<int> &pat, const vector<int> &text, const unordered_set<int> &wc)
+namespace
+{
+    typedef unsigned long long ULL;
+    const unsigned P = NTT_MOD;
+
+    /**
+     * Random weight in [1, P) of the symbol `c`, for the given seed.
+     */
+    unsigned symbol_weight(uint64_t seed, unsigned c)
+    {
+        // splitmix64
+        uint64_t z = seed + (c + 1) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        return z % (P - 1) + 1;
+    }
+
+    /**
+     * `acc[k] += x[k] * y[k]` modulo P, for all k.
+     */
+    void add_product(vector<unsigned> &acc, const vector<unsigned> &x, const vector<unsigned> &y)
+    {
+        for (size_t k = 0; k < acc.size(); k++)
+            acc[k] = (acc[k] + (ULL)x[k] * y[k]) % P;
+    }
+}
+
+PmWcText::PmWcText(const vector<int> &text, const unordered_set<int> &wc)
+    : n(text.size()), wc(wc), rng(std::random_device{}())
 {
-    int n = text.size();
-    int m = pat.size();
     // Flip t before FFT
-    vector<int> t_rev(text.rbegin(), text.rend());
+    t1.resize(n);
+    t2.resize(n);
+    t3.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        unsigned c = wc.contains(text[n - 1 - i]) ? 0 : text[n - 1 - i];
+        t1[i] = c;
+        t2[i] = c * c;
+        t3[i] = c * c * c;
+    }
+}
+
+void PmWcText::prepare_transforms(int log_n)
+{
+    if (log_size >= log_n)
+        return;
+    log_size = log_n;
+    f1 = t1;
+    fft(f1, log_size);
+    f2 = t2;
+    fft(f2, log_size);
+    f3 = t3;
+    fft(f3, log_size);
+}
+
+void PmWcText::prepare_rounds(size_t nb_rounds, int log_n)
+{
+    if (rounds_log_size < log_n)
+    {
+        rounds_log_size = log_n;
+        rounds.clear();
+    }
+    while (rounds.size() < nb_rounds)
+    {
+        Round r{rng(), {}, {}};
+        r.ind = vec_map(t1, [](unsigned c)
+                        { return c != 0; });
+        r.weight = vec_map(t1, [&](unsigned c)
+                           { return c != 0 ? symbol_weight(r.seed, c) : 0; });
+        fft(r.ind, rounds_log_size);
+        fft(r.weight, rounds_log_size);
+        rounds.push_back(std::move(r));
+    }
+}
+
+bool PmWcText::occurs_at(const vector<unsigned> &p, int i) const
+{
+    int m = p.size();
+    for (int j = 0; j < m; j++)
+    {
+        unsigned c = t1[n - 1 - (i + j)];
+        if (p[j] != 0 && c != 0 && p[j] != c)
+            return false;
+    }
+    return true;
+}
+
+double pm_wc_cost(int m, int n)
+{
+    // Three convolutions in the time domain, or three transforms per
+    // conv_cost(Ntt) and four per call once the text is transformed
+    double time_cost = 3 * conv_cost(ConvBackend::Auto, m, n);
+    double freq_cost = conv_cost(ConvBackend::Ntt, m, n) * 4 / 3;
+    return std::min(time_cost, freq_cost);
+}
+
+void pm_wc(std::span<const int> pat, PmWcText &text, vector<bool> &res)
+{
+    int n = text.n;
+    int m = pat.size();
+    assert(m > 0);
+    res.assign(n, false);
+    if (m > n)
+        return;
+
+    auto &p = text.pv, &acc = text.acc, &a = text.a, &b = text.b;
+    p.resize(m);
+    for (int j = 0; j < m; j++)
+        p[j] = text.wc.contains(pat[j]) ? 0 : pat[j];
+    // p^3, then -2 p^2 modulo P
+    auto p3 = [&](int j)
+    { return p[j] * p[j] * p[j]; };
+    auto p2 = [&](int j) -> unsigned
+    { return (ULL)(p[j] * p[j]) * (P - 2) % P; };
+
+    // sum_j p_j t_{i+j} (p_j - t_{i+j})^2 = p^3 * t - 2 p^2 * t^2 + p * t^3
+    ConvBackend backend = choose_conv_backend(m, n);
+    if (3 * conv_cost(backend, m, n) <= pm_wc_cost(m, n))
+    {
+        int len = n + m - 1;
+        acc.resize(len);
+        b.resize(len);
+        a.resize(m);
+
+        for (int j = 0; j < m; j++)
+            a[j] = p3(j);
+        convolve_into(a, text.t1, acc, backend);
+
+        for (int j = 0; j < m; j++)
+            a[j] = p2(j);
+        convolve_into(a, text.t2, b, backend);
+        for (int i = 0; i < n; i++)
+        {
+            acc[i] = (acc[i] + b[i]) % P;
+        }
+
+        convolve_into(p, text.t3, b, backend);
+        for (int i = 0; i < n; i++)
+        {
+            acc[i] = (acc[i] + b[i]) % P;
+        }
+    }
+    else
+    {
+        // Sum the products in the frequency domain, then a single inverse transform
+        text.prepare_transforms(std::bit_width((unsigned)(n + m - 2)));
+        int log_n = text.log_size;
+        int N = 1 << log_n;
+        acc.assign(N, 0);
+        a.resize(N);
+
+        std::fill(a.begin() + m, a.end(), 0);
+        for (int j = 0; j < m; j++)
+            a[j] = p3(j);
+        fft(std::span<unsigned>(a), log_n);
+        add_product(acc, a, text.f1);
+
+        std::fill(a.begin() + m, a.end(), 0);
+        for (int j = 0; j < m; j++)
+            a[j] = p2(j);
+        fft(std::span<unsigned>(a), log_n);
+        add_product(acc, a, text.f2);
+
+        std::fill(a.begin() + m, a.end(), 0);
+        std::copy(p.begin(), p.end(), a.begin());
+        fft(std::span<unsigned>(a), log_n);
+        add_product(acc, a, text.f3);
+
+        fft(std::span<unsigned>(acc), log_n, true);
+    }
+
+    for (int j = m - 1; j < n; j++)
+    {
+        res[n - j - 1] = acc[j] == 0;
+    }
+}
+
+vector<bool> pm_wc(const vector<int> &pat, PmWcText &text)
+{
+    vector<bool> res;
+    pm_wc(pat, text, res);
+    return res;
+}
+
+vector<bool> pm_wc_randomized(const vector<int> &pat, PmWcText &text, double fp_bound, bool verify)
+{
+    int n = text.n;
+    int m = pat.size();
+    assert(m > 0 && fp_bound > 0);
+    if (m > n)
+        return vector<bool>(n, false);
+
+    // Small patterns: the exact algorithm is cheaper than transforms
+    if (choose_conv_backend(m, n) != ConvBackend::Ntt)
+        return pm_wc(pat, text);
+
     auto wc_zero = [&](int c)
-    { return wc.contains(c) ? 0 : c; };
+    { return text.wc.contains(c) ? 0 : c; };
     vector<unsigned> p = vec_map(pat, wc_zero);
-    vector<unsigned> t = vec_map(t_rev, wc_zero);
-
-    auto p3 = vec_map(p, [](int i)
-                      { return i * i * i; });
-    auto p2 = vec_map(p, [](int i)
-                      { return i * i; });
-    auto t3 = vec_map(t, [](int i)
-                      { return i * i * i; });
-    auto t2 = vec_map(t, [](int i)
-                      { return i * i; });
-    auto conv1 = conv(p3, t);
-    auto conv2 = conv(p2, t2);
-    auto conv3 = conv(p, t3);
 
-    for (int i = 0; i < n; i++)
+    // With random weights w (positions) and r (symbols), the score
+    //   sum_j w_j (r(p_j) - r(t_{i+j}))   over non-wildcard pairs
+    // is 0 for an occurrence, and for a non-occurrence it is a non-zero
+    // polynomial of degree 2, hence 0 with probability at most 2 / (P - 1).
+    size_t nb_rounds = 1;
+    double err = 2.0 / (P - 1);
+    while ((n - m + 1) * std::pow(err, nb_rounds) > fp_bound)
+        nb_rounds++;
+    int log_n = std::bit_width((unsigned)(n + m - 2));
+    text.prepare_rounds(nb_rounds, log_n);
+    log_n = text.rounds_log_size;
+
+    vector<bool> res(n, false);
+    std::fill(res.begin(), res.begin() + (n - m + 1), true);
+    std::uniform_int_distribution<unsigned> distrib(1, P - 1);
+    auto &acc = text.acc, &a = text.a, &b = text.b;
+    for (size_t k = 0; k < nb_rounds; k++)
+    {
+        const auto &round = text.rounds[k];
+        a.assign(m, 0);
+        b.assign(m, 0);
+        for (int j = 0; j < m; j++)
+        {
+            if (p[j] == 0)
+                continue;
+            unsigned w = distrib(text.rng);
+            a[j] = (ULL)w * symbol_weight(round.seed, p[j]) % P;
+            b[j] = P - w;
+        }
+        fft(a, log_n);
+        fft(b, log_n);
+        acc.assign(1 << log_n, 0);
+        add_product(acc, a, round.ind);
+        add_product(acc, b, round.weight);
+        fft(acc, log_n, true);
+
+        for (int j = m - 1; j < n; j++)
+        {
+            if (acc[j] != 0)
+                res[n - j - 1] = false;
+        }
+    }
+
+    if (verify)
     {
-        conv1[i] += -2 * conv2[i] + conv3[i];
+        for (int i = 0; i + m <= n; i++)
+        {
+            if (res[i])
+                res[i] = text.occurs_at(p, i);
+        }
     }
 
-    vector<bool> res(n, false);
-    for (int j = m - 1; j < n; j++)
+    return res;
+}
+
+void PmWcText::prepare_profile(int log_n)
+{
+    if (profile_log_size >= log_n)
+        return;
+    profile_log_size = log_n;
+    symbol_spectra.clear();
+    ind_spectrum = vec_map(t1, [](unsigned c)
+                           { return c != 0; });
+    fft(ind_spectrum, profile_log_size);
+}
+
+vector<int> mismatch_profile(const vector<int> &pat, PmWcText &text)
+{
+    int n = text.n;
+    int m = pat.size();
+    assert(m > 0);
+    if (m > n)
+        return {};
+
+    auto wc_zero = [&](int c)
+    { return text.wc.contains(c) ? 0 : c; };
+    vector<unsigned> p = vec_map(pat, wc_zero);
+    vector<unsigned> symbols;
+    for (unsigned c : p)
+        if (c != 0)
+            symbols.push_back(c);
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+
+    vector<int> res(n - m + 1, 0);
+    // Brute force, when cheaper than one transform per symbol
+    if (conv_cost(ConvBackend::Direct, m, n) <= conv_cost(ConvBackend::Ntt, m, n) * (symbols.size() + 2) / 3)
+    {
+        for (int i = 0; i + m <= n; i++)
+        {
+            for (int j = 0; j < m; j++)
+            {
+                unsigned c = text.t1[n - 1 - (i + j)];
+                res[i] += p[j] != 0 && c != 0 && p[j] != c;
+            }
+        }
+        return res;
+    }
+
+    // Mismatches = (non-wildcard pairs) - sum over symbols c of (pairs of c)
+    text.prepare_profile(std::bit_width((unsigned)(n + m - 2)));
+    int log_n = text.profile_log_size;
+    auto &acc = text.acc, &a = text.a;
+    a = vec_map(p, [](unsigned c)
+                { return c != 0; });
+    fft(a, log_n);
+    acc.assign(1 << log_n, 0);
+    add_product(acc, a, text.ind_spectrum);
+
+    for (unsigned c : symbols)
+    {
+        auto &spectrum = text.symbol_spectra[c];
+        if (spectrum.empty())
+        {
+            spectrum = vec_map(text.t1, [&](unsigned x)
+                               { return x == c; });
+            fft(spectrum, log_n);
+        }
+        a = vec_map(p, [&](unsigned x)
+                    { return x == c ? P - 1 : 0; });
+        fft(a, log_n);
+        add_product(acc, a, spectrum);
+    }
+    fft(acc, log_n, true);
+
+    for (int i = 0; i + m <= n; i++)
+        res[i] = acc[n - 1 - i];
+    return res;
+}
+
+vector<int> mismatch_profile_approx(const vector<int> &pat, PmWcText &text, double eps, double delta)
+{
+    int n = text.n;
+    int m = pat.size();
+    assert(m > 0 && eps > 0 && delta > 0);
+    if (m > n)
+        return {};
+
+    // With `k` buckets, a mismatching pair collides with probability 1 / k,
+    // so that the estimate of one repetition is unbiased with variance at
+    // most 4 M^2 / k, for M mismatches. By Chebyshev's inequality,
+    // k * reps >= 4 / (eps^2 delta) suffices.
+    int k = std::max(2, (int)std::ceil(2 / eps));
+    int reps = std::ceil(4 / (eps * eps * delta * k));
+
+    auto wc_zero = [&](int c)
+    { return text.wc.contains(c) ? 0 : c; };
+    vector<unsigned> p = vec_map(pat, wc_zero);
+    std::unordered_set<unsigned> symbols;
+    for (unsigned c : p)
+        if (c != 0)
+            symbols.insert(c);
+    // Each repetition transforms up to 2 k vectors
+    double ntt = conv_cost(ConvBackend::Ntt, m, n) / 3;
+    double exact_cost = std::min(conv_cost(ConvBackend::Direct, m, n), ntt * (symbols.size() + 2));
+    if (exact_cost <= ntt * (2 * k * reps + 2))
+        return mismatch_profile(pat, text);
+
+    // sum over repetitions of (non-wildcard pairs) - (pairs in the same bucket)
+    text.prepare_profile(std::bit_width((unsigned)(n + m - 2)));
+    int log_n = text.profile_log_size;
+    auto &acc = text.acc, &a = text.a, &b = text.b;
+    a = vec_map(p, [&](unsigned c)
+                { return c != 0 ? reps : 0; });
+    fft(a, log_n);
+    acc.assign(1 << log_n, 0);
+    add_product(acc, a, text.ind_spectrum);
+
+    vector<unsigned> t_bucket(n), p_bucket(m);
+    for (int r = 0; r < reps; r++)
     {
-        res[n - j - 1] = conv1[j] == 0;
+        uint64_t seed = text.rng();
+        auto bucket = [&](unsigned c)
+        { return c != 0 ? symbol_weight(seed, c) % k : k; };
+        t_bucket = vec_map(text.t1, bucket);
+        p_bucket = vec_map(p, bucket);
+        vector<bool> used(k + 1, false);
+        for (unsigned x : p_bucket)
+            used[x] = true;
+
+        for (int h = 0; h < k; h++)
+        {
+            if (!used[h])
+                continue;
+            a = vec_map(p_bucket, [&](unsigned x)
+                        { return x == (unsigned)h ? P - 1 : 0; });
+            fft(a, log_n);
+            b = vec_map(t_bucket, [&](unsigned x)
+                        { return x == (unsigned)h; });
+            fft(b, log_n);
+            add_product(acc, a, b);
+        }
     }
+    fft(acc, log_n, true);
 
+    vector<int> res(n - m + 1);
+    for (int i = 0; i + m <= n; i++)
+    {
+        double estimate = (double)acc[n - 1 - i] * k / ((k - 1) * (double)reps);
+        res[i] = std::min(m, (int)std::lround(estimate));
+    }
     return res;
 }
 
+vector<bool> pm_wc(const vector<int> &pat, const vector<int> &text, const unordered_set<int> &wc)
+{
+    PmWcText t(text, wc);
+    return pm_wc(pat, t);
+}
+
 vector<bool> pm_wc_naive(vector<int> &p, vector<int> &t, unordered_set<int> &wc)
 {
     int m = p.size();
@@ -210,3 +588,87 @@ void test_pm_wc_jump(int it, mt19937 &rng)
         }
     }
 }
+
+void check_pm_wc_randomized(vector<int> &p, vector<int> &t)
+{
+    unordered_set<int> wc = {'#'};
+    auto res_exact = pm_wc_naive(p, t, wc);
+    PmWcText text(t, wc);
+    assert(pm_wc(p, text) == res_exact);
+    assert(pm_wc_randomized(p, text, 1e-9, true) == res_exact);
+    assert(pm_wc_randomized(p, text) == res_exact);
+}
+
+void test_pm_wc_randomized(int it, mt19937 &rng)
+{
+    // Binary texts with wildcards, and patterns copied from the text with a
+    // few changes, long enough to use transforms
+    std::uniform_int_distribution<> symbol(0, 4);
+    for (int i = 0; i < it; i++)
+    {
+        vector<int> t(3000);
+        for (auto &c : t)
+        {
+            int x = symbol(rng);
+            c = x < 2 ? 'a' + x : (x == 2 ? 'a' : '#');
+        }
+        int m = 300;
+        int start = std::uniform_int_distribution<>(0, t.size() - m)(rng);
+        vector<int> p(t.begin() + start, t.begin() + start + m);
+        for (int k = 0; k < i % 3; k++)
+            p[std::uniform_int_distribution<>(0, m - 1)(rng)] = symbol(rng) < 2 ? 'b' : '#';
+        check_pm_wc_randomized(p, t);
+    }
+}
+
+vector<int> mismatch_profile_naive(const vector<int> &p, const vector<int> &t, const unordered_set<int> &wc)
+{
+    int m = p.size();
+    int n = t.size();
+    vector<int> res(std::max(0, n - m + 1), 0);
+    for (int i = 0; i + m <= n; i++)
+        for (int j = 0; j < m; j++)
+            res[i] += p[j] != t[i + j] && !wc.contains(p[j]) && !wc.contains(t[i + j]);
+    return res;
+}
+
+void test_mismatch_profile(int it, mt19937 &rng)
+{
+    unordered_set<int> wc = {'#'};
+    for (int i = 0; i < it; i++)
+    {
+        // Small inputs (brute force), then larger ones (transforms)
+        vector<int> p = random_str(10, rng);
+        vector<int> t = random_str(100, rng);
+        PmWcText text(t, wc);
+        assert(mismatch_profile(p, text) == mismatch_profile_naive(p, t, wc));
+
+        std::uniform_int_distribution<> symbol(0, i % 2 == 0 ? 3 : 1000);
+        p.resize(500);
+        t.resize(4000);
+        for (auto &c : p)
+            c = symbol(rng) == 0 ? '#' : 1000 + symbol(rng);
+        for (auto &c : t)
+            c = symbol(rng) == 0 ? '#' : 1000 + symbol(rng);
+        PmWcText big(t, wc);
+        auto expected = mismatch_profile_naive(p, t, wc);
+        assert(mismatch_profile(p, big) == expected);
+    }
+
+    // Estimates are within eps of the exact value with probability 1 - delta,
+    // for each alignment (with inputs large enough for transforms to pay off)
+    std::uniform_int_distribution<> symbol(0, 10000);
+    vector<int> p(12000), t(24000);
+    for (auto &c : p)
+        c = symbol(rng) < 100 ? '#' : symbol(rng);
+    for (auto &c : t)
+        c = symbol(rng) < 100 ? '#' : symbol(rng);
+    PmWcText text(t, wc);
+    auto expected = mismatch_profile_naive(p, t, wc);
+    double eps = 0.5, delta = 0.25;
+    auto approx = mismatch_profile_approx(p, text, eps, delta);
+    int bad = 0;
+    for (size_t k = 0; k < expected.size(); k++)
+        bad += std::abs(approx[k] - expected[k]) > eps * expected[k];
+    assert(bad <= 2 * delta * expected.size());
+}
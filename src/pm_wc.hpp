@@ -6,8 +6,11 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
 #include <random>
+#include <span>
+#include <cstdint>
 
 using std::unordered_set;
 using std::vector;
@@ -20,10 +23,144 @@ using std::vector;
  */
 vector<bool> pm_wc(const vector<int> &p, const vector<int> &t, const unordered_set<int> &wc);
 
+/**
+ * Text prepared for many calls to `pm_wc` with different patterns.
+ *
+ * Keeps the text-side vectors of the convolutions and their transforms,
+ * which do not depend on the pattern, and the buffers of the convolutions,
+ * which are reused from one call to the next.
+ */
+class PmWcText
+{
+private:
+    int n;
+    unordered_set<int> wc;
+    // Reversed text with wildcards replaced by 0, its square and its cube
+    vector<unsigned> t1, t2, t3;
+    // Transforms of t1, t2 and t3 of size 2^log_size (-1 until needed)
+    int log_size = -1;
+    vector<unsigned> f1, f2, f3;
+
+    /**
+     * Text-side transforms of one round of `pm_wc_randomized`: the indicator
+     * of the non-wildcard positions, and their random symbol weights.
+     */
+    struct Round
+    {
+        uint64_t seed;
+        vector<unsigned> ind, weight;
+    };
+    // Rounds, with transforms of size 2^rounds_log_size
+    int rounds_log_size = -1;
+    vector<Round> rounds;
+    std::mt19937_64 rng;
+
+    // Transforms of size 2^profile_log_size of the indicator of the
+    // non-wildcard positions, and of the positions of each symbol
+    int profile_log_size = -1;
+    vector<unsigned> ind_spectrum;
+    std::unordered_map<unsigned, vector<unsigned>> symbol_spectra;
+
+    // Pattern with wildcards replaced by 0, and convolution buffers
+    vector<unsigned> pv, acc, a, b;
+
+    /**
+     * Compute the transforms of t1, t2 and t3, of size at least 2^log_n.
+     */
+    void prepare_transforms(int log_n);
+
+    /**
+     * Compute `nb_rounds` rounds, with transforms of size at least 2^log_n.
+     */
+    void prepare_rounds(size_t nb_rounds, int log_n);
+
+    /**
+     * Set the size of the transforms of `mismatch_profile` to at least 2^log_n.
+     */
+    void prepare_profile(int log_n);
+
+    /**
+     * Check an occurrence of `p` (with wildcards replaced by 0) at position `i`.
+     */
+    bool occurs_at(const vector<unsigned> &p, int i) const;
+
+    friend void pm_wc(std::span<const int> p, PmWcText &t, vector<bool> &res);
+    friend vector<bool> pm_wc_randomized(const vector<int> &p, PmWcText &t, double fp_bound, bool verify);
+    friend vector<int> mismatch_profile(const vector<int> &p, PmWcText &t);
+    friend vector<int> mismatch_profile_approx(const vector<int> &p, PmWcText &t, double eps, double delta);
+
+public:
+    PmWcText(const vector<int> &t, const unordered_set<int> &wc);
+};
+
+/**
+ * Find occurences of `p` in the prepared text `t`.
+ *
+ * Same as `pm_wc` above. When transforms pay off, the three products of the
+ * algorithm are summed in the frequency domain: a call costs three forward
+ * transforms and one inverse transform, since the transforms of the text
+ * are computed once.
+ */
+vector<bool> pm_wc(const vector<int> &p, PmWcText &t);
+
+/**
+ * Same as above, writing the occurrences to `res`.
+ *
+ * Once the buffers of `t` and `res` are large enough, and the transforms of
+ * the text are computed, does no heap allocation: use this version when
+ * matching many patterns.
+ */
+void pm_wc(std::span<const int> p, PmWcText &t, vector<bool> &res);
+
+/**
+ * Estimated time, in nanoseconds, of a call to `pm_wc` with a pattern of
+ * length `m` in a prepared text of length `n`.
+ */
+double pm_wc_cost(int m, int n);
+
+/**
+ * Find occurences of `p` in the prepared text `t`, Monte Carlo version.
+ *
+ * Each round draws random weights for the symbols and the positions of `p`,
+ * and costs two forward transforms and one inverse transform. Occurrences
+ * are always reported, and the probability that some non-occurrence is also
+ * reported is at most `fp_bound`, which sets the number of rounds.
+ * With `verify`, candidates are checked symbol by symbol and the result is
+ * exact, in additional time `O(m)` per candidate.
+ */
+vector<bool> pm_wc_randomized(const vector<int> &p, PmWcText &t,
+                              double fp_bound = 1e-9, bool verify = false);
+
+/**
+ * Number of mismatches of `p` at every alignment in the prepared text `t`.
+ *
+ * Returns a vector `A` of size `max(0, n - m + 1)` s.t. `A[i]` is the number
+ * of positions `j` where `p[j]` and `T[i + j]` are different and neither is
+ * a wildcard (the Hamming distance, not counting wildcards).
+ *
+ * Uses one product per distinct symbol of `p`, plus one, summed in the
+ * frequency domain before a single inverse transform: suited to small
+ * alphabets. The transforms of the text are kept for the next calls.
+ */
+vector<int> mismatch_profile(const vector<int> &p, PmWcText &t);
+
+/**
+ * Approximate number of mismatches of `p` at every alignment in `t`.
+ *
+ * Same as `mismatch_profile`, with symbols hashed at random into
+ * `O(1 / eps)` buckets and averaged over `O(1 / (eps delta))` repetitions, so
+ * that the cost does not depend on the size of the alphabet. Each entry is
+ * within `eps` times the exact value with probability at least `1 - delta`.
+ * Falls back to the exact computation when it is cheaper.
+ */
+vector<int> mismatch_profile_approx(const vector<int> &p, PmWcText &t, double eps, double delta = 0.1);
+
 vector<bool> pm_wc_jump(
     int p_start, int m,
     vector<int> &t, unordered_set<int> &wc,
     vector<int> &next_tr);
 
 void test_pm_wc(int it, std::mt19937 &rng);
-void test_pm_wc_jump(int it, std::mt19937 &rng);
\ No newline at end of file
+void test_pm_wc_jump(int it, std::mt19937 &rng);
+void test_pm_wc_randomized(int it, std::mt19937 &rng);
+void test_mismatch_profile(int it, std::mt19937 &rng);
\ No newline at end of file
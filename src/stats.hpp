@@ -0,0 +1,132 @@
+/**
+ * Optional instrumentation of the LCEW data structure.
+ *
+ * Query counters and construction timers are only compiled in when
+ * `LCEW_STATS` is defined (see `make stats`). Otherwise, everything wrapped
+ * in `LCEW_STATS_ONLY` disappears and queries do no extra work.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+#ifdef LCEW_STATS
+#define LCEW_STATS_ONLY(...) __VA_ARGS__
+#else
+#define LCEW_STATS_ONLY(...)
+#endif
+
+/**
+ * Work done by LCEW queries.
+ */
+struct QueryStats
+{
+    size_t queries = 0;
+    /** Number of (usual) LCE queries. */
+    size_t lce_calls = 0;
+    /** Number of times a run of wildcards was skipped. */
+    size_t wildcard_skips = 0;
+    /** Number of lookups in the jump table. */
+    size_t jump_hops = 0;
+
+    QueryStats &operator+=(const QueryStats &other)
+    {
+        queries += other.queries;
+        lce_calls += other.lce_calls;
+        wildcard_skips += other.wildcard_skips;
+        jump_hops += other.jump_hops;
+        return *this;
+    }
+};
+
+/**
+ * Time spent (in seconds) in each phase of the construction.
+ */
+struct BuildStats
+{
+    /** Suffix tree and arrays, or fingerprints with the fingerprint backend. */
+    double suffix_structure = 0;
+    double rmq = 0;
+    /** Computation of the bit vectors of transitions and selected positions. */
+    double navigation = 0;
+    /** Pattern matching for the blocks between selected positions. */
+    double occurrences = 0;
+    double jump_dp = 0;
+
+    double total() const
+    {
+        return suffix_structure + rmq + navigation + occurrences + jump_dp;
+    }
+};
+
+/**
+ * Memory used (in bytes) by each component of the data structure.
+ */
+struct MemoryUsage
+{
+    size_t text = 0;
+    size_t wildcards = 0;
+    /** Bit vectors of transitions and selected positions, with rank and select support. */
+    size_t navigation = 0;
+    size_t jump = 0;
+    /** The (usual) LCE data structure. */
+    size_t lce = 0;
+
+    size_t total() const
+    {
+        return text + wildcards + navigation + jump + lce;
+    }
+};
+
+/**
+ * Adds the time elapsed between its construction and destruction to `*slot`.
+ */
+class PhaseTimer
+{
+private:
+    double *slot;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    PhaseTimer(double *slot) : slot(slot), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() { stop(); }
+
+    /**
+     * Stop the timer before the end of its scope.
+     */
+    void stop()
+    {
+        if (slot)
+            *slot += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        slot = nullptr;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const QueryStats &s)
+{
+    return os << "queries: " << s.queries
+              << ", lce calls: " << s.lce_calls
+              << ", wildcard skips: " << s.wildcard_skips
+              << ", jump hops: " << s.jump_hops;
+}
+
+inline std::ostream &operator<<(std::ostream &os, const BuildStats &s)
+{
+    return os << "suffix structure: " << s.suffix_structure << "s"
+              << ", rmq: " << s.rmq << "s"
+              << ", navigation: " << s.navigation << "s"
+              << ", occurrences: " << s.occurrences << "s"
+              << ", jump dp: " << s.jump_dp << "s";
+}
+
+inline std::ostream &operator<<(std::ostream &os, const MemoryUsage &m)
+{
+    return os << "text: " << m.text << "B"
+              << ", wildcards: " << m.wildcards << "B"
+              << ", navigation: " << m.navigation << "B"
+              << ", jump: " << m.jump << "B"
+              << ", lce: " << m.lce << "B"
+              << ", total: " << m.total() << "B";
+}
@@ -74,7 +74,10 @@ void SuffixTree::STDelete(STvertex *w) {
 }
 
 void SuffixTree::Delete_suffix_tree() {
+    /* the auxiliary vertex above the root, whose edges all lead to the root */
+    STvertex *top = root->f;
     STDelete(root);
+    delete top;
     SA.clear(); RANK.clear(); LCP.clear(); DBF.clear();
 }
 
@@ -131,7 +134,6 @@ void SuffixTree::Compute_suffix_arrays() {
     for (int i = 0; i < n; ++i) {
         RANK[SA[i]] = i;
     }
-    Compute_RMQ();
 }
 
 int SuffixTree::LCE(int i, int j) {
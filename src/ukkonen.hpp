@@ -82,10 +82,16 @@ public:
     int LCS(int pos1, int pos2);
 
     /**
-     * \brief  Create the suffix arrays of the text.
+     * \brief  Create the suffix, rank and LCP arrays of the text.
      */
     void Compute_suffix_arrays();
 
+    /**
+     * \brief  Build the sparse table for range minimum queries over the LCP
+     *         array. Must be called after Compute_suffix_arrays().
+     */
+    void Compute_RMQ();
+
     /**
      * \brief  Compute the longest common extension.
      * \param  i index in the text
@@ -106,6 +112,4 @@ private:
     int LCS_recurse(STvertex *w, int depth, int pos1, int pos2, int &lcs);
 
     void SA_recurse(STvertex *w, int depth, int &top_node);
-
-    void Compute_RMQ();
 };
\ No newline at end of file